@@ -0,0 +1,37 @@
+#include "BMSCrc.h"
+
+#define CRC8_POLY 0x07
+
+static constexpr uint8_t crcShift(uint8_t crc)
+{
+    return (crc & 0x80) ? (uint8_t)((crc << 1) ^ CRC8_POLY) : (uint8_t)(crc << 1);
+}
+
+//CRC of a single byte: eight shifts of the bitwise algorithm, folded at compile time
+static constexpr uint8_t crcEntry(int value)
+{
+    return crcShift(crcShift(crcShift(crcShift(crcShift(crcShift(crcShift(crcShift((uint8_t)value))))))));
+}
+
+#define CRC_ENTRY4(n)   crcEntry(n), crcEntry(n + 1), crcEntry(n + 2), crcEntry(n + 3)
+#define CRC_ENTRY16(n)  CRC_ENTRY4(n), CRC_ENTRY4(n + 4), CRC_ENTRY4(n + 8), CRC_ENTRY4(n + 12)
+#define CRC_ENTRY64(n)  CRC_ENTRY16(n), CRC_ENTRY16(n + 16), CRC_ENTRY16(n + 32), CRC_ENTRY16(n + 48)
+
+static_assert(crcEntry(1) == CRC8_POLY, "CRC table generator is broken");
+
+const uint8_t BMSCRC8::table[256] = {
+    CRC_ENTRY64(0), CRC_ENTRY64(64), CRC_ENTRY64(128), CRC_ENTRY64(192)
+};
+
+uint8_t BMSCRC8::computeBitwise(const uint8_t *data, int len)
+{
+    uint8_t crc = 0;
+
+    for (int x = 0; x < len; x++)
+    {
+        crc ^= data[x]; /* XOR-in the next input byte */
+        for (int i = 0; i < 8; i++) crc = crcShift(crc);
+    }
+
+    return crc;
+}
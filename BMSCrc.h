@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * CRC-8 (polynomial 0x07, init 0) used by the bq76PL536 chips on the Tesla module boards.
+ * Table driven, one lookup per byte. The incremental form lets a reply be checked while it
+ * is still coming in, and lets a writer append the CRC without walking the frame twice.
+ */
+class BMSCRC8
+{
+public:
+    BMSCRC8() : crc(0) {}
+    void reset() { crc = 0; }
+    void update(uint8_t data) { crc = table[crc ^ data]; }
+    void update(const uint8_t *data, int len)
+    {
+        for (int x = 0; x < len; x++) crc = table[crc ^ data[x]];
+    }
+    uint8_t value() const { return crc; }
+
+    static uint8_t compute(const uint8_t *data, int len)
+    {
+        BMSCRC8 crc;
+        crc.update(data, len);
+        return crc.value();
+    }
+
+    //The original bit-at-a-time loop. Only kept as the reference for benchmarks and checks.
+    static uint8_t computeBitwise(const uint8_t *data, int len);
+
+private:
+    uint8_t crc;
+    static const uint8_t table[256];
+};
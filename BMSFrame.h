@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include "BMSCrc.h"
+
+#define BMS_MAX_REQUEST 8   //address + register + value/length is all we ever send, leave some room
+
+/*
+ * A request exactly as it goes out on the wire: address (with the write bit applied), payload and,
+ * for writes, the CRC - all in one contiguous buffer so it can be handed to the UART driver in a
+ * single write and sent again for a retry without being rebuilt. The caller's request is only read.
+ */
+struct BMSFrame
+{
+    uint8_t bytes[BMS_MAX_REQUEST];
+    uint8_t length;
+    bool isWrite;
+
+    //data is addr, cmd and payload as the callers of BMSUtil::sendData lay it out (addr already shifted)
+    void build(const uint8_t *data, uint8_t dataLen, bool write)
+    {
+        BMSCRC8 crc;
+        if (dataLen > BMS_MAX_REQUEST - 1) dataLen = BMS_MAX_REQUEST - 1;
+        isWrite = write;
+        bytes[0] = write ? (data[0] | 1) : data[0];
+        crc.update(bytes[0]);
+        for (int x = 1; x < dataLen; x++)
+        {
+            bytes[x] = data[x];
+            crc.update(data[x]);
+        }
+        length = dataLen;
+        if (write) bytes[length++] = crc.value();
+    }
+};
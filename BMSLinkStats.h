@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Link health counters for one module. BMSUtil::transact updates them for every attempt it is
+ * handed them for, so retries show up as extra attempts.
+ */
+struct BMSLinkStats
+{
+    uint32_t attempts;
+    uint32_t good;
+    uint32_t timeouts;     //nothing came back at all
+    uint32_t shortFrames;  //reply stopped part way through
+    uint32_t badFrames;    //header did not match the request (garbage or a reply to something else)
+    uint32_t crcErrors;
+    uint32_t latencyMin;   //microseconds, good replies only
+    uint32_t latencyMax;
+    uint64_t latencySum;
+};
@@ -3,24 +3,44 @@
 #include "BMSUtil.h"
 #include "Logger.h"
 
+#define ADC_CTRL_ALL        0b00111101 //ADC Auto mode, read every ADC input we can (Both Temps, Pack, 6 cells)
+#define IO_CTRL_TEMP        0b00000011 //enable temperature measurement VSS pins
+#define FAULT_POR           0x08       //REG_FAULT_STATUS power on reset bit, latched until we clear it
+#define CONFIG_VERIFY_POLLS 120        //read the config registers back every 120 polls (1 minute at 500ms)
+#define BREAKER_FAILED_POLLS 3        //failed polls in a row before we start backing off a module
+#define BREAKER_MAX_BACKOFF  64       //never skip a module for more than this many polls (~30s at 500ms)
 
 BMSModule::BMSModule()
 {
     for (int i = 0; i < 6; i++)
     {
-        cellVolt[i] = 0.0f;
-        lowestCellVolt[i] = 5.0f;
-        highestCellVolt[i] = 0.0f;
+        cellRaw[i] = 0;
+        lowestCellRaw[i] = 0xFFFF;
+        highestCellRaw[i] = 0;
     }
-    moduleVolt = 0.0f;
-    temperatures[0] = 0.0f;
-    temperatures[1] = 0.0f;
-    lowestTemperature = 200.0f;
-    highestTemperature = -100.0f;
-    lowestModuleVolt = 200.0f;
-    highestModuleVolt = 0.0f;
+    moduleRaw = 0;
+    lowestModuleRaw = 0xFFFF;
+    highestModuleRaw = 0;
+    ignoreCellRaw = 0;
+    temperatures[0] = 0;
+    temperatures[1] = 0;
+    lowestTemperature = 20000;
+    highestTemperature = -10000;
     exists = false;
+    alerts = 0;
+    faults = 0;
+    COVFaults = 0;
+    CUVFaults = 0;
+    sensor = 0;
     moduleAddress = 0;
+    adcControl = 0;
+    ioControl = 0;
+    configValid = false;
+    pollsSinceVerify = 0;
+    linkStats = BMSLinkStats();
+    failedPolls = 0;
+    backoff = 0;
+    skipPolls = 0;
 }
 
 /*
@@ -33,11 +53,12 @@ void BMSModule::readStatus()
   payload[0] = moduleAddress << 1; //adresss
   payload[1] = REG_ALERT_STATUS;//Alert Status start
   payload[2] = 0x04;
-  BMSUtil::sendDataWithReply(payload, 3, false, buff, 7);
+  if (BMSUtil::sendDataWithReply(payload, 3, false, buff, 8, &linkStats) != 8) return; //keep the last good status
   alerts = buff[3];
   faults = buff[4];
   COVFaults = buff[5];
   CUVFaults = buff[6];
+  Logger::debug("Module %i   alerts=%X   faults=%X   COV=%X   CUV=%X", moduleAddress, alerts, faults, COVFaults, CUVFaults);
 }
 
 uint8_t BMSModule::getFaults()
@@ -81,81 +102,132 @@ void BMSModule::readSetpoint()
   Tset = 35 + (5 * (buff[9] >> 4));
 } */
 
-bool BMSModule::readModuleValues()
+/*
+Full single module read: status, ADC setup, start a conversion on this module only and read it back.
+BMSModuleManager normally starts the conversion for the whole pack with one broadcast instead and
+only calls setupADC() and readADCValues() per module.
+*/
+bool BMSModule::readModuleValues(bool withStatus, bool withTemps)
+{
+    if (withStatus) readStatus();
+    setupADC();
+    startConversion();
+    return readADCValues(withTemps);
+}
+
+/*
+The ADC and IO control registers keep their value until the module resets, so they are only written
+on first contact, whenever the module reports a power on reset, or when the periodic read back
+finds them different from our shadow copy. The POR bit is latched, so it is cleared once the
+registers are written again; a module that resets later sets it again and gets rewritten.
+ADC_CTRL always includes the temperature inputs. Scans that skip the temperatures just read a shorter
+block back, switching the register would cost an extra write per module twice every temperature cycle.
+*/
+void BMSModule::setupADC()
+{
+    if (faults & FAULT_POR) configValid = false; //module came out of reset, its registers are back at the defaults
+
+    if (configValid && ++pollsSinceVerify >= CONFIG_VERIFY_POLLS)
+    {
+        pollsSinceVerify = 0;
+        if (!verifyConfig()) configValid = false;
+    }
+    if (!configValid)
+    {
+        configValid = writeRegister(REG_IO_CTRL, IO_CTRL_TEMP);
+        if (configValid) ioControl = IO_CTRL_TEMP;
+        adcControl = 0; //unknown until written below
+        pollsSinceVerify = 0;
+    }
+
+    if (adcControl != ADC_CTRL_ALL)
+    {
+        adcControl = writeRegister(REG_ADC_CTRL, ADC_CTRL_ALL) ? ADC_CTRL_ALL : 0;
+    }
+
+    if ((faults & FAULT_POR) && configValid && adcControl == ADC_CTRL_ALL)
+    {
+        //write a one then a zero to clear the latched bit, like clearFaults does for the whole pack
+        if (writeRegister(REG_FAULT_STATUS, FAULT_POR) && writeRegister(REG_FAULT_STATUS, 0)) faults &= ~FAULT_POR;
+    }
+}
+
+/*
+Read both control registers back in one go and compare them with what we last wrote
+*/
+bool BMSModule::verifyConfig()
 {
     uint8_t payload[4];
-    uint8_t buff[50];
-    uint8_t calcCRC;
-    bool retVal = false;
-    int retLen;
-    float tempCalc;
-    float tempTemp;
-    
+    uint8_t buff[8];
+
     payload[0] = moduleAddress << 1;
-    
-    readStatus();
-    Logger::debug("Module %i   alerts=%X   faults=%X   COV=%X   CUV=%X", moduleAddress, alerts, faults, COVFaults, CUVFaults);
-    
     payload[1] = REG_ADC_CTRL;
-    payload[2] = 0b00111101; //ADC Auto mode, read every ADC input we can (Both Temps, Pack, 6 cells)
-    BMSUtil::sendDataWithReply(payload, 3, true, buff, 3);
- 
-    payload[1] = REG_IO_CTRL;
-    payload[2] = 0b00000011; //enable temperature measurement VSS pins
-    BMSUtil::sendDataWithReply(payload, 3, true, buff, 3);
-            
+    payload[2] = 2; //ADC_CTRL and IO_CTRL
+    if (BMSUtil::sendDataWithReply(payload, 3, false, buff, 6, &linkStats) != 6) return false;
+    //only the temperature enables and sleep bit of IO_CTRL are ours, the GPIO bits follow the pins
+    if (buff[3] != adcControl || (buff[4] & 0x07) != ioControl)
+    {
+        Logger::warn("Module %i lost its ADC configuration", moduleAddress);
+        return false;
+    }
+    return true;
+}
+
+bool BMSModule::writeRegister(uint8_t reg, uint8_t value)
+{
+    uint8_t payload[4];
+    uint8_t buff[8];
+
+    payload[0] = moduleAddress << 1;
+    payload[1] = reg;
+    payload[2] = value;
+    return BMSUtil::sendDataWithReply(payload, 3, true, buff, 4, &linkStats) == 4;
+}
+
+/*
+Forget the shadow copy so the next setupADC() writes the registers again. Needed after anything that
+changes them behind our back (broadcast sleep/wake, reset).
+*/
+void BMSModule::invalidateConfig()
+{
+    configValid = false;
+}
+
+void BMSModule::startConversion()
+{
+    uint8_t payload[4];
+    uint8_t buff[8];
+
+    payload[0] = moduleAddress << 1;
     payload[1] = REG_ADC_CONV; //start all ADC conversions
     payload[2] = 1;
-    BMSUtil::sendDataWithReply(payload, 3, true, buff, 3);
-                
+    BMSUtil::sendDataWithReply(payload, 3, true, buff, 4, &linkStats);
+}
+
+/*
+Read back the results of the last conversion (GPAI, 6 cells and both temperature inputs in one block).
+Without the temperatures the read stops after the cells, the conversion itself is the same.
+*/
+bool BMSModule::readADCValues(bool withTemps)
+{
+    uint8_t payload[4];
+    uint8_t buff[50];
+    int retLen;
+
+    payload[0] = moduleAddress << 1;
     payload[1] = REG_GPAI; //start reading registers at the module voltage registers
-    payload[2] = 0x12; //read 18 bytes (Each value takes 2 - ModuleV, CellV1-6, Temp1, Temp2)
-    retLen = BMSUtil::sendDataWithReply(payload, 3, false, buff, 22);
-            
-    calcCRC = BMSUtil::genCRC(buff, retLen-1);
-    Logger::debug("Sent CRC: %x     Calculated CRC: %x", buff[21], calcCRC);
-
-    //18 data bytes, address, command, length, and CRC = 22 bytes returned
-    //Also validate CRC to ensure we didn't get garbage data.
-    if ( (retLen == 22) && (buff[21] == calcCRC) )
-    {
-        if (buff[0] == (moduleAddress << 1) && buff[1] == REG_GPAI && buff[2] == 0x12) //Also ensure this is actually the reply to our intended query
-        {
-            //payload is 2 bytes gpai, 2 bytes for each of 6 cell voltages, 2 bytes for each of two temperatures (18 bytes of data)
-            moduleVolt = (buff[3] * 256 + buff[4]) * 0.002034609f;
-            if (moduleVolt > highestModuleVolt) highestModuleVolt = moduleVolt;
-            if (moduleVolt < lowestModuleVolt) lowestModuleVolt = moduleVolt;            
-            for (int i = 0; i < 6; i++) 
-            {
-                cellVolt[i] = (buff[5 + (i * 2)] * 256 + buff[6 + (i * 2)]) * 0.000381493f;
-                if (lowestCellVolt[i] > cellVolt[i] && cellVolt[i] >= IgnoreCell) lowestCellVolt[i] = cellVolt[i];
-                if (highestCellVolt[i] < cellVolt[i]) highestCellVolt[i] = cellVolt[i];
-            }
-            
-            //Now using steinhart/hart equation for temperatures. We'll see if it is better than old code.
-            tempTemp = (1.78f / ((buff[17] * 256 + buff[18] + 2) / 33046.0f) - 3.57f);
-            tempTemp *= 1000.0f;
-            tempCalc =  1.0f / (0.0007610373573f + (0.0002728524832 * logf(tempTemp)) + (powf(logf(tempTemp), 3) * 0.0000001022822735f));            
-            
-            temperatures[0] = tempCalc - 273.15f;            
-            
-            tempTemp = 1.78f / ((buff[19] * 256 + buff[20] + 9) / 33068.0f) - 3.57f;
-            tempTemp *= 1000.0f;
-            tempCalc = 1.0f / (0.0007610373573f + (0.0002728524832 * logf(tempTemp)) + (powf(logf(tempTemp), 3) * 0.0000001022822735f));
-            temperatures[1] = tempCalc - 273.15f;
-            
-            if (getLowTemp() < lowestTemperature) lowestTemperature = getLowTemp();
-            if (getHighTemp() > highestTemperature) highestTemperature = getHighTemp();
-
-            Logger::debug("Got voltage and temperature readings");
-            retVal = true;
-        }        
-    }
-    else
+    payload[2] = withTemps ? 0x12 : 0x0E; //read 18 bytes (Each value takes 2 - ModuleV, CellV1-6, Temp1, Temp2) or 14 without the temps
+    retLen = BMSUtil::sendDataWithReply(payload, 3, false, buff, payload[2] + 4, &linkStats);
+
+    //18 (or 14) data bytes, address, command, length, and CRC = 22 (18) bytes returned
+    //The reply parser has already matched the header against our query and validated the CRC
+    //byte by byte, so a full length reply is known good.
+    if (retLen != payload[2] + 4)
     {
-        Logger::error("Invalid module response received for module %i  len: %i   crc: %i   calc: %i", 
-                      moduleAddress, retLen, buff[21], calcCRC);
+        Logger::error("Invalid module response received for module %i  len: %i", moduleAddress, retLen);
+        return false;
     }
+    decodeADCValues(buff, withTemps);
      
      //turning the temperature wires off here seems to cause weird temperature glitches
    // payload[1] = REG_IO_CTRL;
@@ -164,111 +236,241 @@ bool BMSModule::readModuleValues()
    // delay(3);        
    // BMSUtil::getReply(buff, 50);    //TODO: we're not validating the reply here. Perhaps check to see if a valid reply came back    
     
-    return retVal;
+    return true;
+}
+
+/*
+Turn a validated GPAI block reply (header, 14 or 18 data bytes, CRC) into module, cell and, if it
+holds them, temperature values and update the min/max tracking. Voltages are kept as the raw counts,
+temperatures are looked up in the thermistor table.
+*/
+void BMSModule::decodeADCValues(const uint8_t *buff, bool withTemps)
+{
+    //payload is 2 bytes gpai, 2 bytes for each of 6 cell voltages, 2 bytes for each of two temperatures (18 bytes of data)
+    moduleRaw = buff[3] * 256 + buff[4];
+    if (moduleRaw > highestModuleRaw) highestModuleRaw = moduleRaw;
+    if (moduleRaw < lowestModuleRaw) lowestModuleRaw = moduleRaw;
+    for (int i = 0; i < 6; i++) 
+    {
+        cellRaw[i] = buff[5 + (i * 2)] * 256 + buff[6 + (i * 2)];
+        if (lowestCellRaw[i] > cellRaw[i] && cellRaw[i] >= ignoreCellRaw) lowestCellRaw[i] = cellRaw[i];
+        if (highestCellRaw[i] < cellRaw[i]) highestCellRaw[i] = cellRaw[i];
+    }
+
+    if (withTemps)
+    {
+        temperatures[0] = BMSThermistor::toCentidegrees(buff[17] * 256 + buff[18], 0);
+        temperatures[1] = BMSThermistor::toCentidegrees(buff[19] * 256 + buff[20], 1);
+
+        for (int t = 0; t < 2; t++)
+        {
+            if (temperatures[t] == TEMP_CENTI_INVALID) continue; //a dead sensor is not a record low
+            if (temperatures[t] < lowestTemperature) lowestTemperature = temperatures[t];
+            if (temperatures[t] > highestTemperature) highestTemperature = temperatures[t];
+        }
+
+        Logger::debug("Got voltage and temperature readings");
+    }
+}
+
+/*
+Circuit breaker for a flaky module. Once BREAKER_FAILED_POLLS polls in a row have failed the module is
+skipped for 1, 2, 4 ... up to BREAKER_MAX_BACKOFF polls between attempts, so its timeouts don't eat
+into every scan of the rest of the chain. Call once per scan.
+*/
+bool BMSModule::isPollDue()
+{
+    if (skipPolls == 0) return true;
+    skipPolls--;
+    return false;
+}
+
+void BMSModule::recordPoll(bool ok)
+{
+    if (ok)
+    {
+        if (backoff > 0) Logger::info("Module %i is responding again", moduleAddress);
+        failedPolls = 0;
+        backoff = 0;
+        return;
+    }
+
+    if (failedPolls < 255) failedPolls++;
+    if (failedPolls < BREAKER_FAILED_POLLS) return;
+    backoff = (backoff == 0) ? 1 : backoff * 2;
+    if (backoff > BREAKER_MAX_BACKOFF) backoff = BREAKER_MAX_BACKOFF;
+    skipPolls = backoff;
+    Logger::warn("Module %i keeps failing, skipping it for %i polls", moduleAddress, backoff);
+}
+
+int BMSModule::getBackoff()
+{
+    return backoff;
+}
+
+const BMSLinkStats &BMSModule::getLinkStats()
+{
+    return linkStats;
 }
 
 float BMSModule::getCellVoltage(int cell)
 {
     if (cell < 0 || cell > 5) return 0.0f;
-    return cellVolt[cell];
+    return cellRaw[cell] * CELL_VOLT_LSB;
 }
 
 float BMSModule::getLowCellV()
 {
-    float lowVal = 10.0f;
-    for (int i = 0; i < 6; i++) if (cellVolt[i] < lowVal && cellVolt[i] > IgnoreCell) lowVal = cellVolt[i];
-    return lowVal;
+    uint16_t lowVal = getLowCellRaw();
+    return (lowVal == 0xFFFF) ? 10.0f : lowVal * CELL_VOLT_LSB;
 }
 
 float BMSModule::getHighCellV()
 {
-    float hiVal = 0.0f;
-    for (int i = 0; i < 6; i++) if (cellVolt[i] > hiVal) hiVal = cellVolt[i];
-    return hiVal;
+    return getHighCellRaw() * CELL_VOLT_LSB;
 }
 
 float BMSModule::getAverageV()
 {
-    int x =0;
-    float avgVal = 0.0f;
+    int x = 0;
+    uint32_t sum = 0;
     for (int i = 0; i < 6; i++) 
     {
-      if (cellVolt[i] > IgnoreCell)
+      if (cellRaw[i] > ignoreCellRaw)
       {
         x++;
-        avgVal += cellVolt[i];
+        sum += cellRaw[i];
       }
     }
     
-    avgVal /= x;
-    return avgVal;    
+    return sum * CELL_VOLT_LSB / x;
 }
 
 float BMSModule::getHighestModuleVolt()
 {
-    return highestModuleVolt;
+    return highestModuleRaw * MODULE_VOLT_LSB;
 }
 
 float BMSModule::getLowestModuleVolt()
 {
-    return lowestModuleVolt;
+    return lowestModuleRaw * MODULE_VOLT_LSB;
 }
 
 float BMSModule::getHighestCellVolt(int cell)
 {
     if (cell < 0 || cell > 5) return 0.0f;
-    return highestCellVolt[cell];    
+    return highestCellRaw[cell] * CELL_VOLT_LSB;
 }
 
 float BMSModule::getLowestCellVolt(int cell)
 {
     if (cell < 0 || cell > 5) return 0.0f;
-    return lowestCellVolt[cell];
+    if (lowestCellRaw[cell] == 0xFFFF) return 5.0f; //nothing read yet
+    return lowestCellRaw[cell] * CELL_VOLT_LSB;
 }
 
 float BMSModule::getHighestTemp()
 {
-    return highestTemperature;
+    return highestTemperature * 0.01f;
 }
 
 float BMSModule::getLowestTemp()
 {
-    return lowestTemperature;
+    return lowestTemperature * 0.01f;
 }
 
 float BMSModule::getLowTemp()
 {
-   return (temperatures[0] < temperatures[1]) ? temperatures[0] : temperatures[1]; 
+   return getLowTempCenti() * 0.01f;
 }
 
 float BMSModule::getHighTemp()
 {
-   return (temperatures[0] < temperatures[1]) ? temperatures[1] : temperatures[0];     
+   return getHighTempCenti() * 0.01f;
 }
 
 float BMSModule::getAvgTemp()
 {
   if (sensor == 0)
   {
-    return (temperatures[0] + temperatures[1]) / 2.0f;
+    return (temperatures[0] + temperatures[1]) * 0.005f;
   }
   else
   {
-    return temperatures[sensor-1];
+    return temperatures[sensor-1] * 0.01f;
   }
 }
 
 float BMSModule::getModuleVoltage()
 {
-    return moduleVolt;
+    return moduleRaw * MODULE_VOLT_LSB;
 }
 
 float BMSModule::getTemperature(int temp)
 {
     if (temp < 0 || temp > 1) return 0.0f;
+    return temperatures[temp] * 0.01f;
+}
+
+uint16_t BMSModule::getCellRaw(int cell)
+{
+    if (cell < 0 || cell > 5) return 0;
+    return cellRaw[cell];
+}
+
+//0xFFFF when every cell is at or below the ignore level
+uint16_t BMSModule::getLowCellRaw()
+{
+    uint16_t lowVal = 0xFFFF;
+    for (int i = 0; i < 6; i++) if (cellRaw[i] < lowVal && cellRaw[i] > ignoreCellRaw) lowVal = cellRaw[i];
+    return lowVal;
+}
+
+uint16_t BMSModule::getHighCellRaw()
+{
+    uint16_t hiVal = 0;
+    for (int i = 0; i < 6; i++) if (cellRaw[i] > hiVal) hiVal = cellRaw[i];
+    return hiVal;
+}
+
+uint16_t BMSModule::getModuleRaw()
+{
+    return moduleRaw;
+}
+
+uint16_t BMSModule::getCellMillivolts(int cell)
+{
+    if (cell < 0 || cell > 5) return 0;
+    return ((uint32_t)cellRaw[cell] * 6250 + 8191) / 16383;
+}
+
+int16_t BMSModule::getTemperatureCenti(int temp)
+{
+    if (temp < 0 || temp > 1) return 0;
     return temperatures[temp];
 }
 
+int16_t BMSModule::getLowTempCenti()
+{
+   return (temperatures[0] < temperatures[1]) ? temperatures[0] : temperatures[1]; 
+}
+
+int16_t BMSModule::getHighTempCenti()
+{
+   return (temperatures[0] < temperatures[1]) ? temperatures[1] : temperatures[0];     
+}
+
+int16_t BMSModule::getAvgTempCenti()
+{
+  if (sensor == 0) return (temperatures[0] + temperatures[1]) / 2;
+  return temperatures[sensor-1];
+}
+
+uint16_t BMSModule::getIgnoreCellRaw()
+{
+    return ignoreCellRaw;
+}
+
 void BMSModule::setAddress(int newAddr)
 {
     if (newAddr < 0 || newAddr > MAX_MODULE_ADDR) return;
@@ -292,11 +494,12 @@ void BMSModule::settempsensor(int tempsensor)
 
 void BMSModule::setExists(bool ex)
 {
+    if (ex != exists) configValid = false; //a board (re)appearing needs its registers set up again
     exists = ex;
 }
 
 void BMSModule::setIgnoreCell(float Ignore)
 {
-  IgnoreCell = Ignore;
+  ignoreCellRaw = (Ignore > 0.0f) ? (uint16_t)(Ignore / CELL_VOLT_LSB) : 0;
 }
 
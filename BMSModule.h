@@ -1,13 +1,27 @@
 #pragma once
 
  #include <stdint.h>
+ #include "BMSLinkStats.h"
+ #include "BMSThermistor.h"
+
+#define CELL_VOLT_LSB       0.000381493f  //V per cell ADC count, 6.250V / 16383
+#define MODULE_VOLT_LSB     0.002034609f  //V per GPAI count, 33.333V / 16383
  
 class BMSModule
 {
   public:
     BMSModule();
     void readStatus();
-    bool readModuleValues();
+    bool readModuleValues(bool withStatus = true, bool withTemps = true);
+    void setupADC();
+    void invalidateConfig();
+    void startConversion();
+    bool readADCValues(bool withTemps = true);
+    void decodeADCValues(const uint8_t *buff, bool withTemps = true);
+    bool isPollDue();
+    void recordPoll(bool ok);
+    int getBackoff();
+    const BMSLinkStats &getLinkStats();
     float getCellVoltage(int cell);
     float getLowCellV();
     float getHighCellV();
@@ -23,6 +37,17 @@ class BMSModule
     float getAvgTemp();
     float getModuleVoltage();
     float getTemperature(int temp);
+    //the same values as stored, for integer comparisons and sums
+    uint16_t getCellRaw(int cell);
+    uint16_t getLowCellRaw();
+    uint16_t getHighCellRaw();
+    uint16_t getModuleRaw();
+    uint16_t getCellMillivolts(int cell);
+    int16_t getTemperatureCenti(int temp);
+    int16_t getLowTempCenti();
+    int16_t getHighTempCenti();
+    int16_t getAvgTempCenti();
+    uint16_t getIgnoreCellRaw();
     uint8_t getFaults();
     uint8_t getAlerts();
     uint8_t getCOVCells();
@@ -36,21 +61,33 @@ class BMSModule
     
     
   private:
-    float cellVolt[6];          // calculated as 16 bit value * 6.250 / 16383 = volts
-    float lowestCellVolt[6];
-    float highestCellVolt[6];
-    float moduleVolt;          // calculated as 16 bit value * 33.333 / 16383 = volts
-    float temperatures[2];     // Don't know the proper scaling at this point
-    float lowestTemperature;
-    float highestTemperature;
-    float lowestModuleVolt;
-    float highestModuleVolt;
-    float IgnoreCell;
+    //Voltages stay in ADC counts as the module sent them, volts only when a getter asks
+    uint16_t cellRaw[6];       // * CELL_VOLT_LSB = volts
+    uint16_t lowestCellRaw[6];
+    uint16_t highestCellRaw[6];
+    uint16_t moduleRaw;        // * MODULE_VOLT_LSB = volts
+    uint16_t lowestModuleRaw;
+    uint16_t highestModuleRaw;
+    uint16_t ignoreCellRaw;    //cells at or below this count are left out (unconnected cell inputs)
+    int16_t temperatures[2];   //0.01 degrees C
+    int16_t lowestTemperature;
+    int16_t highestTemperature;
     bool exists;
-    int alerts;
-    int faults;
-    int COVFaults;
-    int CUVFaults;
-    int sensor;
+    uint8_t alerts;
+    uint8_t faults;
+    uint8_t COVFaults;
+    uint8_t CUVFaults;
+    uint8_t sensor;
     uint8_t moduleAddress;     //1 to 0x3E
+    uint8_t adcControl;        //shadow of REG_ADC_CTRL as last written
+    uint8_t ioControl;         //shadow of REG_IO_CTRL as last written
+    bool configValid;          //shadow registers match the module, no need to write them
+    uint8_t pollsSinceVerify;
+    BMSLinkStats linkStats;
+    uint8_t failedPolls;       //polls in a row that did not get a good reading
+    uint8_t backoff;           //current circuit breaker back off in polls, 0 = closed
+    uint8_t skipPolls;         //polls left to skip before the next attempt
+
+    bool verifyConfig();
+    bool writeRegister(uint8_t reg, uint8_t value);
 };
@@ -2,6 +2,8 @@
 #include "BMSModuleManager.h"
 #include "BMSUtil.h"
 #include "Logger.h"
+#include "BMSProfiler.h"
+#include "HeapMonitor.h"
 #include "pin_config.h"
 
 extern EEPROMSettings settings;
@@ -13,11 +15,20 @@ BMSModuleManager::BMSModuleManager()
         modules[i].setExists(false);
         modules[i].setAddress(i);
     }
+    numFoundModules = 0;
+    assignedModules = 0;
     lowestPackVolt = 1000.0f;
     highestPackVolt = 0.0f;
     lowestPackTemp = 200.0f;
     highestPackTemp = -100.0f;
     isFaulted = false;
+    pollCount = 0;
+    tempPollCycles = BMS_TEMP_POLL_CYCLES;
+    statusPollCycles = BMS_STATUS_POLL_CYCLES;
+    capture = false;
+    captureMark = 0;
+    captureLost = 0;
+    snapshot.aggregate(packStats);
 }
 
 void BMSModuleManager::balanceCells()
@@ -25,15 +36,16 @@ void BMSModuleManager::balanceCells()
     uint8_t payload[4];
     uint8_t buff[30];
     uint8_t balance = 0;//bit 0 - 5 are to activate cell balancing 1-6
+    BMS_PROFILE(PROF_BALANCE);
+    uint32_t lowCell = packStats.cells.count ? packStats.cells.min : 0xFFFF; //as of the last scan
   
-    for (int address = 1; address <= MAX_MODULE_ADDR; address++)
+    for (int n = 0; n < numFoundModules; n++)
     {
-      if (modules[address].isExisting())
-      {
+        int address = activeModules[n];
         balance = 0;
         for (int i = 0; i < 6; i++)
         {
-            if (getLowCellVolt() < modules[address].getCellVoltage(i))
+            if (lowCell < modules[address].getCellRaw(i))
             {
                 balance = balance | (1<<i);
             }
@@ -44,16 +56,12 @@ void BMSModuleManager::balanceCells()
             payload[0] = address << 1;
             payload[1] = REG_BAL_TIME;
             payload[2] = 60; //60 second balance limit, if not triggered to balance it will stop after 5 seconds
-            BMSUtil::sendData(payload, 3, true);
-            delay(2);
-            BMSUtil::getReply(buff, 30);
+            BMSUtil::transact(payload, 3, true, buff, 4);
 
             payload[0] = address << 1;
             payload[1] = REG_BAL_CTRL;
             payload[2] = balance; //write balance state to register
-            BMSUtil::sendData(payload, 3, true);
-            delay(2);
-            BMSUtil::getReply(buff, 30);
+            BMSUtil::transact(payload, 3, true, buff, 4);
 
             if (Logger::isDebug()) //read registers back out to check if everthing is good
             {
@@ -61,19 +69,14 @@ void BMSModuleManager::balanceCells()
                 payload[0] = address << 1;
                 payload[1] = REG_BAL_TIME;
                 payload[2] = 1; //
-                BMSUtil::sendData(payload, 3, false);
-                delay(2);
-                BMSUtil::getReply(buff, 30);
+                BMSUtil::transact(payload, 3, false, buff, 5);
          
                 payload[0] = address << 1;
                 payload[1] = REG_BAL_CTRL;
                 payload[2] = 1; //
-                BMSUtil::sendData(payload, 3, false);
-                delay(2);
-                BMSUtil::getReply(buff, 30);
+                BMSUtil::transact(payload, 3, false, buff, 5);
             }
         }
-      }
     }
 }
 
@@ -91,18 +94,21 @@ void BMSModuleManager::setupBoards()
     uint8_t payload[3];
     uint8_t buff[10];
     int retLen;
+    int rounds = 0;
 
     payload[0] = 0;
     payload[1] = 0;
     payload[2] = 1;
     
-    while (1 == 1)
+    //a round hands out at most one address. Give up after twice as many rounds as there are addresses
+    //so a board that answers at 0 but never takes one (or more boards than addresses) can't hang us
+    while (rounds++ < 2 * MAX_MODULE_ADDR)
     {
         payload[0] = 0;
         payload[1] = 0;
         payload[2] = 1;
-        retLen = BMSUtil::sendDataWithReply(payload, 3, false, buff, 4);
-        if (retLen == 4)
+        retLen = BMSUtil::sendDataWithReply(payload, 3, false, buff, 5);
+        if (retLen == 5)
         {
             if (buff[0] == 0x80 && buff[1] == 0 && buff[2] == 1)
             {
@@ -115,14 +121,13 @@ void BMSModuleManager::setupBoards()
                         payload[0] = 0;
                         payload[1] = REG_ADDR_CTRL;
                         payload[2] = y | 0x80;
-                        BMSUtil::sendData(payload, 3, true);
-                        delay(3);
-                        if (BMSUtil::getReply(buff, 10) > 2)
+                        //single attempt: if the echo got lost the board may already have taken the address
+                        if (BMSUtil::transact(payload, 3, true, buff, 4) == 4)
                         {
                             if (buff[0] == (0x81) && buff[1] == REG_ADDR_CTRL && buff[2] == (y + 0x80)) 
                             {
-                                modules[y].setExists(true);
-                                numFoundModules++;
+                                setActive(y, true);
+                                assignedModules++;
                                 Logger::debug("Address assigned");
                             }
                         }
@@ -137,32 +142,64 @@ void BMSModuleManager::setupBoards()
 }
 
 /*
- * Iterate through all 62 possible board addresses (1-62) to see if they respond
+ * Mark a module address as present or not and keep activeModules, the present addresses in ascending
+ * order, in step. Everything that walks the pack goes through that list instead of all 62 addresses.
+ */
+void BMSModuleManager::setActive(int address, bool active)
+{
+    int pos = 0;
+
+    modules[address].setExists(active);
+    while (pos < numFoundModules && activeModules[pos] < address) pos++;
+    bool listed = pos < numFoundModules && activeModules[pos] == address;
+    if (active && !listed)
+    {
+        memmove(&activeModules[pos + 1], &activeModules[pos], numFoundModules - pos);
+        activeModules[pos] = address;
+        numFoundModules++;
+    }
+    else if (!active && listed)
+    {
+        memmove(&activeModules[pos], &activeModules[pos + 1], numFoundModules - pos - 1);
+        numFoundModules--;
+    }
+}
+
+/*
+ * Look for boards starting at address 1. setupBoards hands out addresses in sequence, so once we have
+ * seen as many boards as it assigned since the last renumber, or BMS_DISCOVERY_MAX_GAP addresses in a
+ * row were empty, the rest of the 62 possible addresses (1-62) are not probed. Without a renumber since
+ * boot only the gap rule applies. Each probe returns as soon as the reply is in.
  */
 void BMSModuleManager::findBoards()
 {
     uint8_t payload[3];
     uint8_t buff[8];
+    int expected = assignedModules; //0 if setupBoards found nothing or never ran
+    int seen = 0;
+    int emptyRun = 0;
+    bool found;
 
-    numFoundModules = 0;
     payload[0] = 0;
     payload[1] = 0; //read registers starting at 0
     payload[2] = 1; //read one byte
     for (int x = 1; x <= MAX_MODULE_ADDR; x++)
     {
-        modules[x].setExists(false);
-        payload[0] = x << 1;
-        BMSUtil::sendData(payload, 3, false);
-        delay(20);
-        if (BMSUtil::getReply(buff, 8) > 4)
+        found = false;
+        if (emptyRun < BMS_DISCOVERY_MAX_GAP && (expected == 0 || seen < expected))
         {
-            if (buff[0] == (x << 1) && buff[1] == 0 && buff[2] == 1 && buff[4] > 0) {
-                modules[x].setExists(true);
-                numFoundModules++;
-                Logger::debug("Found module with address: %X", x); 
-            }
+            payload[0] = x << 1;
+            //the reply parser already checked address, register, length and CRC
+            found = (BMSUtil::sendDataWithReply(payload, 3, false, buff, 5) == 5);
+        }
+        setActive(x, found);
+        if (found)
+        {
+            seen++;
+            emptyRun = 0;
+            Logger::debug("Found module with address: %X", x);
         }
-        delay(5);
+        else emptyRun++;
     }
 }
 
@@ -177,11 +214,9 @@ void BMSModuleManager::renumberBoardIDs()
     uint8_t buff[8];
     int attempts = 1;
 
-    for (int y = 1; y < 63; y++) 
-    {
-        modules[y].setExists(false);  
-        numFoundModules = 0;
-    }    
+    for (int n = 0; n < numFoundModules; n++) modules[activeModules[n]].setExists(false);
+    numFoundModules = 0;
+    assignedModules = 0;
     
     while (attempts < 3)
     {
@@ -190,8 +225,8 @@ void BMSModuleManager::renumberBoardIDs()
         payload[2] = 0xA5;//data to cause a reset
         BMSUtil::sendData(payload, 3, true);
         delay(100);
-        BMSUtil::getReply(buff, 8);
-        if (buff[0] == 0x7F && buff[1] == 0x3C && buff[2] == 0xA5 && buff[3] == 0x57) break;
+        //the echo may be short or missing, don't look at bytes that never arrived
+        if (BMSUtil::getReply(buff, 8) >= 4 && buff[0] == 0x7F && buff[1] == 0x3C && buff[2] == 0xA5 && buff[3] == 0x57) break;
         attempts++;
     }
     
@@ -235,12 +270,11 @@ void BMSModuleManager::sleepBoards()
 {
     uint8_t payload[3];
     uint8_t buff[8];
+    for (int x = 1; x <= MAX_MODULE_ADDR; x++) modules[x].invalidateConfig(); //IO_CTRL gets overwritten
     payload[0] = 0x7F; //broadcast
     payload[1] = REG_IO_CTRL;//IO ctrl start
     payload[2] = 0x04;//write sleep bit
-    BMSUtil::sendData(payload, 3, true);
-    delay(2);
-    BMSUtil::getReply(buff, 8);
+    BMSUtil::transact(payload, 3, true, buff, 4);
 }
 
 /*
@@ -251,24 +285,19 @@ void BMSModuleManager::wakeBoards()
 {
     uint8_t payload[3];
     uint8_t buff[8];
+    for (int x = 1; x <= MAX_MODULE_ADDR; x++) modules[x].invalidateConfig(); //IO_CTRL gets overwritten
     payload[0] = 0x7F; //broadcast
     payload[1] = REG_IO_CTRL;//IO ctrl start
     payload[2] = 0x00;//write sleep bit
-    BMSUtil::sendData(payload, 3, true);
-    delay(2);
-    BMSUtil::getReply(buff, 8);
+    BMSUtil::transact(payload, 3, true, buff, 4);
   
     payload[0] = 0x7F; //broadcast
     payload[1] = REG_ALERT_STATUS;//Fault Status
     payload[2] = 0x04;//data to cause a reset
-    BMSUtil::sendData(payload, 3, true);
-    delay(2);
-    BMSUtil::getReply(buff, 8);
+    BMSUtil::transact(payload, 3, true, buff, 4);
     payload[0] = 0x7F; //broadcast
     payload[2] = 0x00;//data to clear
-    BMSUtil::sendData(payload, 3, true);
-    delay(2);
-    BMSUtil::getReply(buff, 8);
+    BMSUtil::transact(payload, 3, true, buff, 4);
 }
 
 static float getSoC(float v)
@@ -281,44 +310,70 @@ static float getSoC(float v)
 }
 
 
+/*
+Start an ADC conversion on every module at once by writing REG_ADC_CONV to the broadcast address.
+All cells in the pack are then sampled at the same moment and each module only needs its results read.
+*/
+void BMSModuleManager::startConversions()
+{
+    uint8_t payload[3];
+    uint8_t buff[8];
+    payload[0] = 0x7F; //broadcast
+    payload[1] = REG_ADC_CONV;
+    payload[2] = 1; //start all ADC conversions
+    BMSUtil::sendDataWithReply(payload, 3, true, buff, 4);
+}
+
 void BMSModuleManager::getAllVoltTemp()
 {
-    extern String bms_modules_text;
-    bms_modules_text = "";
-    packVolt = 0.0f;
-    float lowCell = 1000.0f;
-    float highCell = -1000.0f;
-    for (int x = 1; x <= MAX_MODULE_ADDR; x++)
+    BMS_PROFILE(PROF_SCAN);
+    //Cells are read every scan. Temperatures move slowly and status rarely changes, so those are
+    //only read every few scans - the status at once if the fault line says something happened.
+    bool faultLine = (digitalRead(11) == LOW);
+    bool readTemps = (pollCount % tempPollCycles) == 0;
+    bool readStatus = faultLine || (pollCount % statusPollCycles) == 0;
+    bool pollDue[MAX_MODULE_ADDR];          // by position in activeModules, false while the circuit breaker backs off
+    if (capture) startCapture(micros(), pollCount, faultLine);
+    pollCount++;
     {
-        if (modules[x].isExisting()) 
+        BMS_HEAP_SCOPE(HEAP_SCAN); //the bus part, updatePackStats below is a site of its own
+        for (int n = 0; n < numFoundModules; n++)
+        {
+            int x = activeModules[n];
+            pollDue[n] = modules[x].isPollDue();
+#if BMS_BROADCAST_ADC
+            if (pollDue[n])
+            {
+                if (readStatus) modules[x].readStatus();
+                modules[x].setupADC();
+            }
+            if (capture) drainCapture(false);
+#endif
+        }
+#if BMS_BROADCAST_ADC
+        if (numFoundModules > 0) startConversions();
+#endif
+        for (int n = 0; n < numFoundModules; n++)
         {
-            Logger::debug("");
-            Logger::debug("Module %i exists. Reading voltage and temperature values", x);
-            modules[x].readModuleValues();
-            Logger::debug("Module voltage: %f", modules[x].getModuleVoltage());
-            float low = modules[x].getLowCellV();
-            float high = modules[x].getHighCellV();
-            Logger::debug("Lowest Cell V: %f     Highest Cell V: %f", low, high);
-            if (low < lowCell) lowCell = low;
-            if (high > highCell) highCell = high;
-            Logger::debug("Temp1: %f       Temp2: %f", modules[x].getTemperature(0), modules[x].getTemperature(1));
-            packVolt += modules[x].getModuleVoltage();
-            if (modules[x].getLowTemp() < lowestPackTemp) lowestPackTemp = modules[x].getLowTemp();
-            if (modules[x].getHighTemp() > highestPackTemp) highestPackTemp = modules[x].getHighTemp();            
-
-            bms_modules_text += String("Mod #") + (int)x + ": " + modules[x].getModuleVoltage() + "v l: " + low + "v h: " + high + "v d=" + (high - low) + "v\n"; 
+            int x = activeModules[n];
+            if (pollDue[n])
+            {
+                BMS_PROFILE(PROF_MODULE_READ);
+                Logger::debug("");
+                Logger::debug("Module %i exists. Reading voltage and temperature values", x);
+#if BMS_BROADCAST_ADC
+                modules[x].recordPoll(modules[x].readADCValues(readTemps));
+#else
+                modules[x].recordPoll(modules[x].readModuleValues(readStatus, readTemps));
+#endif
+            }
+            if (capture) drainCapture(false);
         }
     }
 
-    packVolt = packVolt/Pstring;
-    if (packVolt > highestPackVolt) highestPackVolt = packVolt;
-    if (packVolt < lowestPackVolt) lowestPackVolt = packVolt;
-    float delta = highCell - lowCell;
-
-    bms_status = String("SoC: ") + (int)getSoC(packVolt) + " %\n\n";
-    bms_status += String("Volts: ") + packVolt + "v low:" + lowCell + "v high: " + highCell + "v d=" + delta;
+    updatePackStats();
 
-    if (digitalRead(11) == LOW) {
+    if (faultLine) {
         if (!isFaulted) Logger::error("One or more BMS modules have entered the fault state!");
         isFaulted = true;
     }
@@ -327,32 +382,136 @@ void BMSModuleManager::getAllVoltTemp()
         if (isFaulted) Logger::info("All modules have exited a faulted state");
         isFaulted = false;
     }
+
+    if (capture) endCapture();
 }
 
-float BMSModuleManager::getLowCellVolt()
+/*
+Capture mode for host/bmsreplay: print every scan, the frames it put on the bus and what was decoded
+from them, all on lines starting with "CAP " so they can be cut out of a console log.
+  CAP S <start us> <scan> <fault line> <P strings> <temp cycles> <status cycles>
+  CAP T|R ...                                                  every frame, BMSTrace::dump() format
+  CAP M <addr> <cell 1-6> <temp 1-2> <module V> <alerts> <faults> <COV> <CUV>
+  CAP E <pack V> <faulted> <frames lost>
+The frames are taken from the trace buffer. They are printed after the scan, unless the buffer gets
+half full first: then they are printed between two modules, so a 62 module chain fits too. That
+pause only happens on big packs. Frames that were overwritten before they could be printed are
+counted as lost.
+*/
+void BMSModuleManager::startCapture(uint32_t scanStart, uint32_t scanPoll, bool faultLine)
 {
-  LowCellVolt = 5.0;
-    for (int x = 1; x <= MAX_MODULE_ADDR; x++)
+    char line[80];
+
+    captureMark = BMSTrace::getTotal();
+    captureLost = 0;
+    snprintf(line, sizeof(line), "CAP S %lu %lu %i %i %i %i", (unsigned long)scanStart, (unsigned long)scanPoll,
+             faultLine ? 1 : 0, Pstring, tempPollCycles, statusPollCycles);
+    Logger::console("%s", line);
+}
+
+//Print the frames recorded since the last call. Unless all is set only once half the buffer is used.
+void BMSModuleManager::drainCapture(bool all)
+{
+    char line[4 + BMS_TRACE_LINE];
+    BMSTraceEntry entry;
+    uint32_t frames = BMSTrace::getTotal() - captureMark;
+
+    if (!all && frames < BMS_TRACE_ENTRIES / 2) return;
+    if (frames > (uint32_t)BMSTrace::getCount())
     {
-        if (modules[x].isExisting()) 
-        {
-           if (modules[x].getLowCellV() <  LowCellVolt)  LowCellVolt = modules[x].getLowCellV(); 
-        }
+        captureLost += frames - BMSTrace::getCount();
+        frames = BMSTrace::getCount();
+    }
+    for (int i = BMSTrace::getCount() - frames; i < BMSTrace::getCount(); i++)
+    {
+        BMSTrace::getEntry(i, entry);
+        memcpy(line, "CAP ", 4);
+        BMSTrace::format(entry, line + 4, sizeof(line) - 4);
+        Logger::console("%s", line);
     }
-    return LowCellVolt;
+    captureMark = BMSTrace::getTotal();
 }
 
-float BMSModuleManager::getHighCellVolt()
+void BMSModuleManager::endCapture()
 {
-  HighCellVolt = 5.0;
-    for (int x = 1; x <= MAX_MODULE_ADDR; x++)
+    char line[160];
+
+    drainCapture(true);
+    for (int n = 0; n < numFoundModules; n++)
     {
-        if (modules[x].isExisting()) 
-        {
-           if (modules[x].getHighCellV() <  HighCellVolt)  HighCellVolt = modules[x].getHighCellV(); 
-        }
+        int x = activeModules[n];
+        snprintf(line, sizeof(line), "CAP M %i %.4f %.4f %.4f %.4f %.4f %.4f %.2f %.2f %.4f %02X %02X %02X %02X", x,
+                 modules[x].getCellVoltage(0), modules[x].getCellVoltage(1), modules[x].getCellVoltage(2),
+                 modules[x].getCellVoltage(3), modules[x].getCellVoltage(4), modules[x].getCellVoltage(5),
+                 modules[x].getTemperature(0), modules[x].getTemperature(1), modules[x].getModuleVoltage(),
+                 modules[x].getAlerts(), modules[x].getFaults(), modules[x].getCOVCells(), modules[x].getCUVCells());
+        Logger::console("%s", line);
     }
-    return HighCellVolt;
+    snprintf(line, sizeof(line), "CAP E %.4f %i %lu", packVolt, isFaulted ? 1 : 0, (unsigned long)captureLost);
+    Logger::console("%s", line);
+}
+
+/*
+Pack voltage, cell and temperature extremes and the display texts from the values the modules
+hold right now. getAllVoltTemp() calls it after every scan, no bus traffic. This is the only place
+the pack statistics are worked out, all the pack wide getters return what it left in packStats.
+*/
+void BMSModuleManager::updatePackStats()
+{
+    extern String bms_modules_text;
+    BMS_PROFILE(PROF_PACK_STATS);
+    BMS_HEAP_SCOPE(HEAP_PACK_STATS);
+
+    snapshot.clear();
+    for (int n = 0; n < numFoundModules; n++) snapshot.addModule(modules[activeModules[n]]);
+    snapshot.aggregate(packStats);
+
+    bms_modules_text = "";
+    for (int p = 0; p < snapshot.getModuleCount(); p++)
+    {
+        float moduleVolt = snapshot.moduleVolts[p] * MODULE_VOLT_LSB;
+        float low = (packStats.moduleLow[p] == 0xFFFF) ? 10.0f : packStats.moduleLow[p] * CELL_VOLT_LSB;
+        float high = packStats.moduleHigh[p] * CELL_VOLT_LSB;
+        Logger::debug("Module voltage: %f", moduleVolt);
+        Logger::debug("Lowest Cell V: %f     Highest Cell V: %f", low, high);
+        Logger::debug("Temp1: %f       Temp2: %f", snapshot.temps[p * 2] * 0.01f, snapshot.temps[p * 2 + 1] * 0.01f);
+
+        bms_modules_text += String("Mod #") + snapshot.getAddress(p) + ": " + moduleVolt + "v l: " + low + "v h: " + high + "v d=" + (high - low) + "v\n"; 
+    }
+
+    packVolt = packStats.moduleVoltSum * MODULE_VOLT_LSB / Pstring;
+    if (packVolt > highestPackVolt) highestPackVolt = packVolt;
+    if (packVolt < lowestPackVolt) lowestPackVolt = packVolt;
+    if (packStats.temps.count > 0 && packStats.temps.min * 0.01f < lowestPackTemp) lowestPackTemp = packStats.temps.min * 0.01f;
+    if (packStats.temps.count > 0 && packStats.temps.max * 0.01f > highestPackTemp) highestPackTemp = packStats.temps.max * 0.01f;
+    float lowCell = (packStats.cells.count > 0) ? packStats.cells.min * CELL_VOLT_LSB : 0.0f;
+    float highCell = packStats.cells.max * CELL_VOLT_LSB;
+    float delta = highCell - lowCell;
+
+    bms_status = String("SoC: ") + (int)getSoC(packVolt) + " %\n\n";
+    bms_status += String("Volts: ") + packVolt + "v low:" + lowCell + "v high: " + highCell + "v d=" + delta;
+}
+
+//Lowest cell of the pack as of the last scan, leaving out ignored cells. 5V before the first scan.
+float BMSModuleManager::getLowCellVolt()
+{
+    return (packStats.cells.count > 0) ? packStats.cells.min * CELL_VOLT_LSB : 5.0f;
+}
+
+float BMSModuleManager::getHighCellVolt()
+{
+    return packStats.cells.max * CELL_VOLT_LSB;
+}
+
+//Address of the module holding the lowest cell, 0 before the first scan
+int BMSModuleManager::getLowCellModule()
+{
+    return snapshot.cellModule(packStats.cells.argmin);
+}
+
+int BMSModuleManager::getHighCellModule()
+{
+    return snapshot.cellModule(packStats.cells.argmax);
 }
 
 float BMSModuleManager::getPackVoltage()
@@ -380,51 +539,68 @@ void BMSModuleManager::setPstrings(int Pstrings)
     Pstring = Pstrings;
 }
 
+/*
+Set how often (every Nth call of getAllVoltTemp) temperatures and the alert/fault status are read.
+Cell voltages are always read.
+*/
+void BMSModuleManager::setPollCycles(int temps, int status)
+{
+    if (temps < 1) temps = 1;
+    if (status < 1) status = 1;
+    tempPollCycles = temps;
+    statusPollCycles = status;
+}
+
+/*
+Turn capture mode on or off. Starting it also restarts the scan count so the slower temperature and
+status poll tiers line up with a replay that starts from a freshly constructed manager.
+*/
+void BMSModuleManager::setCapture(bool enabled)
+{
+    capture = enabled;
+    if (!enabled) return;
+    //start the poll tiers and the config read back from scratch, so a replay runs in step with the capture
+    pollCount = 0;
+    for (int n = 0; n < numFoundModules; n++) modules[activeModules[n]].invalidateConfig();
+}
+
+bool BMSModuleManager::isCapturing()
+{
+    return capture;
+}
+
 void BMSModuleManager::setSensors(int sensor,float Ignore)
 {
-  for (int x = 1; x <= MAX_MODULE_ADDR; x++)
-    {
-        if (modules[x].isExisting()) 
-        {
-          modules[x].settempsensor(sensor);
-          modules[x].setIgnoreCell(Ignore);
-        }
-    }
+  for (int n = 0; n < numFoundModules; n++)
+  {
+      int x = activeModules[n];
+      modules[x].settempsensor(sensor);
+      modules[x].setIgnoreCell(Ignore);
+  }
 }
 
+//Mean over the modules that have a temperature sensor, each as set up with setSensors()
 float BMSModuleManager::getAvgTemperature()
 {
-    float avg = 0.0f;
-    int y = 0; //counter for modules below -70 (no sensors connected)    
-    for (int x = 1; x <= MAX_MODULE_ADDR; x++)
-    {
-        if (modules[x].isExisting()) 
-        {
-          if (modules[x].getAvgTemp() > -70) 
-          {
-            avg += modules[x].getAvgTemp();
-          }
-          else
-          {
-            y++;
-          }
-        }
-    }
-    avg = avg / (float)(numFoundModules-y);
-    
-    return avg;
+    const BMSPackStat &temps = packStats.moduleTemps;
+    return (temps.count > 0) ? temps.sum * 0.01f / temps.count : 0.0f;
 }
 
+//Mean over every cell of the pack that is not ignored
 float BMSModuleManager::getAvgCellVolt()
 {
-    float avg = 0.0f;    
-    for (int x = 1; x <= MAX_MODULE_ADDR; x++)
-    {
-        if (modules[x].isExisting()) avg += modules[x].getAverageV();
-    }
-    avg = avg / (float)numFoundModules;
-    
-    return avg;    
+    const BMSPackStat &cells = packStats.cells;
+    return (cells.count > 0) ? cells.sum * CELL_VOLT_LSB / cells.count : 0.0f;
+}
+
+const BMSPackSnapshot &BMSModuleManager::getSnapshot()
+{
+    return snapshot;
+}
+
+const BMSPackAggregate &BMSModuleManager::getPackStats()
+{
+    return packStats;
 }
 
 void BMSModuleManager::printPackSummary()
@@ -442,104 +618,123 @@ void BMSModuleManager::printPackSummary()
     else Logger::console("                                   All systems go!");
     Logger::console("Modules: %i    Voltage: %fV   Avg Cell Voltage: %fV     Avg Temp: %fC ", numFoundModules, 
                     getPackVoltage(),getAvgCellVolt(), getAvgTemperature());
+    Logger::console("Low Cell: %fV (module %i)   High Cell: %fV (module %i)   Widest Module Spread: %fV (module %i)",
+                    getLowCellVolt(), getLowCellModule(), getHighCellVolt(), getHighCellModule(),
+                    packStats.deltaMax * CELL_VOLT_LSB, snapshot.getAddress(packStats.deltaArg));
     Logger::console("");
-    for (int y = 1; y < 63; y++)
+    for (int n = 0; n < numFoundModules; n++)
     {
-        if (modules[y].isExisting())
-        {
-            faults = modules[y].getFaults();
-            alerts = modules[y].getAlerts();
-            COV = modules[y].getCOVCells();
-            CUV = modules[y].getCUVCells();
+        int y = activeModules[n];
+        faults = modules[y].getFaults();
+        alerts = modules[y].getAlerts();
+        COV = modules[y].getCOVCells();
+        CUV = modules[y].getCUVCells();
             
-            Logger::console("                               Module #%i", y);
+        Logger::console("                               Module #%i", y);
             
-            Logger::console("  Voltage: %fV   (%fV-%fV)     Temperatures: (%fC-%fC)", modules[y].getModuleVoltage(), 
-                            modules[y].getLowCellV(), modules[y].getHighCellV(), modules[y].getLowTemp(), modules[y].getHighTemp());
-            if (faults > 0)
+        Logger::console("  Voltage: %fV   (%fV-%fV)     Temperatures: (%fC-%fC)", modules[y].getModuleVoltage(), 
+                        modules[y].getLowCellV(), modules[y].getHighCellV(), modules[y].getLowTemp(), modules[y].getHighTemp());
+        if (faults > 0)
+        {
+            Logger::console("  MODULE IS FAULTED:");
+            if (faults & 1)
             {
-                Logger::console("  MODULE IS FAULTED:");
-                if (faults & 1)
+                SERIALCONSOLE.print("    Overvoltage Cell Numbers (1-6): ");
+                for (int i = 0; i < 6; i++)
                 {
-                    SERIALCONSOLE.print("    Overvoltage Cell Numbers (1-6): ");
-                    for (int i = 0; i < 6; i++)
+                    if (COV & (1 << i)) 
                     {
-                        if (COV & (1 << i)) 
-                        {
-                            SERIALCONSOLE.print(i+1);
-                            SERIALCONSOLE.print(" ");
-                        }
+                        SERIALCONSOLE.print(i+1);
+                        SERIALCONSOLE.print(" ");
                     }
-                    SERIALCONSOLE.println();
                 }
-                if (faults & 2)
+                SERIALCONSOLE.println();
+            }
+            if (faults & 2)
+            {
+                SERIALCONSOLE.print("    Undervoltage Cell Numbers (1-6): ");
+                for (int i = 0; i < 6; i++)
                 {
-                    SERIALCONSOLE.print("    Undervoltage Cell Numbers (1-6): ");
-                    for (int i = 0; i < 6; i++)
+                    if (CUV & (1 << i)) 
                     {
-                        if (CUV & (1 << i)) 
-                        {
-                            SERIALCONSOLE.print(i+1);
-                            SERIALCONSOLE.print(" ");
-                        }
+                        SERIALCONSOLE.print(i+1);
+                        SERIALCONSOLE.print(" ");
                     }
-                    SERIALCONSOLE.println();
-                }
-                if (faults & 4)
-                {
-                    Logger::console("    CRC error in received packet");
-                }
-                if (faults & 8)
-                {
-                    Logger::console("    Power on reset has occurred");
-                }
-                if (faults & 0x10)
-                {
-                    Logger::console("    Test fault active");
-                }
-                if (faults & 0x20)
-                {
-                    Logger::console("    Internal registers inconsistent");
                 }
+                SERIALCONSOLE.println();
             }
-            if (alerts > 0)
+            if (faults & 4)
             {
-                Logger::console("  MODULE HAS ALERTS:");
-                if (alerts & 1)
-                {
-                    Logger::console("    Over temperature on TS1");
-                }
-                if (alerts & 2)
-                {
-                    Logger::console("    Over temperature on TS2");
-                }
-                if (alerts & 4)
-                {
-                    Logger::console("    Sleep mode active");
-                }
-                if (alerts & 8)
-                {
-                    Logger::console("    Thermal shutdown active");
-                }
-                if (alerts & 0x10)
-                {
-                    Logger::console("    Test Alert");
-                }
-                if (alerts & 0x20)
-                {
-                    Logger::console("    OTP EPROM Uncorrectable Error");
-                }
-                if (alerts & 0x40)
-                {
-                    Logger::console("    GROUP3 Regs Invalid");
-                }
-                if (alerts & 0x80)
-                {
-                    Logger::console("    Address not registered");
-                }                
+                Logger::console("    CRC error in received packet");
+            }
+            if (faults & 8)
+            {
+                Logger::console("    Power on reset has occurred");
+            }
+            if (faults & 0x10)
+            {
+                Logger::console("    Test fault active");
+            }
+            if (faults & 0x20)
+            {
+                Logger::console("    Internal registers inconsistent");
             }
-            if (faults > 0 || alerts > 0) SERIALCONSOLE.println();
         }
+        if (alerts > 0)
+        {
+            Logger::console("  MODULE HAS ALERTS:");
+            if (alerts & 1)
+            {
+                Logger::console("    Over temperature on TS1");
+            }
+            if (alerts & 2)
+            {
+                Logger::console("    Over temperature on TS2");
+            }
+            if (alerts & 4)
+            {
+                Logger::console("    Sleep mode active");
+            }
+            if (alerts & 8)
+            {
+                Logger::console("    Thermal shutdown active");
+            }
+            if (alerts & 0x10)
+            {
+                Logger::console("    Test Alert");
+            }
+            if (alerts & 0x20)
+            {
+                Logger::console("    OTP EPROM Uncorrectable Error");
+            }
+            if (alerts & 0x40)
+            {
+                Logger::console("    GROUP3 Regs Invalid");
+            }
+            if (alerts & 0x80)
+            {
+                Logger::console("    Address not registered");
+            }                
+        }
+        if (faults > 0 || alerts > 0) SERIALCONSOLE.println();
+    }
+}
+
+void BMSModuleManager::printLinkStats()
+{
+    Logger::console("");
+    Logger::console("Module  Attempts      Good  Timeouts     Short  BadFrame       CRC   Latency us (min/avg/max)  Backoff");
+    for (int n = 0; n < numFoundModules; n++)
+    {
+        int y = activeModules[n];
+        const BMSLinkStats &stats = modules[y].getLinkStats();
+        char line[140];
+        snprintf(line, sizeof(line), "#%-5i %9lu %9lu %9lu %9lu %9lu %9lu   %6lu / %6lu / %6lu   %7i", y,
+                 (unsigned long)stats.attempts, (unsigned long)stats.good, (unsigned long)stats.timeouts,
+                 (unsigned long)stats.shortFrames, (unsigned long)stats.badFrames, (unsigned long)stats.crcErrors,
+                 (unsigned long)stats.latencyMin, (unsigned long)(stats.good ? stats.latencySum / stats.good : 0),
+                 (unsigned long)stats.latencyMax, modules[y].getBackoff());
+        SERIALCONSOLE.println(line);
     }
 }
 
@@ -558,39 +753,37 @@ void BMSModuleManager::printPackDetails()
     if (isFaulted) Logger::console("                                           FAULTED!");
     else Logger::console("                                      All systems go!");
     Logger::console("Modules: %i    Voltage: %fV   Avg Cell Voltage: %fV  Low Cell Voltage: %fV   High Cell Voltage: %fV   Avg Temp: %fC ", numFoundModules, 
-                    getPackVoltage(),getAvgCellVolt(),LowCellVolt, HighCellVolt, getAvgTemperature());
+                    getPackVoltage(),getAvgCellVolt(),getLowCellVolt(), getHighCellVolt(), getAvgTemperature());
     Logger::console("");
-    for (int y = 1; y < 63; y++)
+    for (int n = 0; n < numFoundModules; n++)
     {
-        if (modules[y].isExisting())
-        {
-            faults = modules[y].getFaults();
-            alerts = modules[y].getAlerts();
-            COV = modules[y].getCOVCells();
-            CUV = modules[y].getCUVCells();
+        int y = activeModules[n];
+        faults = modules[y].getFaults();
+        alerts = modules[y].getAlerts();
+        COV = modules[y].getCOVCells();
+        CUV = modules[y].getCUVCells();
             
-            SERIALCONSOLE.print("Module #");
-            SERIALCONSOLE.print(y);
-            if (y < 10) SERIALCONSOLE.print(" ");
-            SERIALCONSOLE.print("  ");
-            SERIALCONSOLE.print(modules[y].getModuleVoltage());
+        SERIALCONSOLE.print("Module #");
+        SERIALCONSOLE.print(y);
+        if (y < 10) SERIALCONSOLE.print(" ");
+        SERIALCONSOLE.print("  ");
+        SERIALCONSOLE.print(modules[y].getModuleVoltage());
+        SERIALCONSOLE.print("V");
+        for (int i = 0; i < 6; i++)
+        {
+            if (cellNum < 10) SERIALCONSOLE.print(" ");
+            SERIALCONSOLE.print("  Cell");
+            SERIALCONSOLE.print(cellNum++);                
+            SERIALCONSOLE.print(": ");
+            SERIALCONSOLE.print(modules[y].getCellVoltage(i));
             SERIALCONSOLE.print("V");
-            for (int i = 0; i < 6; i++)
-            {
-                if (cellNum < 10) SERIALCONSOLE.print(" ");
-                SERIALCONSOLE.print("  Cell");
-                SERIALCONSOLE.print(cellNum++);                
-                SERIALCONSOLE.print(": ");
-                SERIALCONSOLE.print(modules[y].getCellVoltage(i));
-                SERIALCONSOLE.print("V");
-            }   
-            SERIALCONSOLE.print("  Neg Term Temp: ");
-            SERIALCONSOLE.print(modules[y].getTemperature(0));
-            SERIALCONSOLE.print("C  Pos Term Temp: ");
-            SERIALCONSOLE.print(modules[y].getTemperature(1)); 
-            SERIALCONSOLE.println("C");
+        }   
+        SERIALCONSOLE.print("  Neg Term Temp: ");
+        SERIALCONSOLE.print(modules[y].getTemperature(0));
+        SERIALCONSOLE.print("C  Pos Term Temp: ");
+        SERIALCONSOLE.print(modules[y].getTemperature(1)); 
+        SERIALCONSOLE.println("C");
             
-        }
     }
 }
 
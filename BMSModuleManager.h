@@ -1,6 +1,7 @@
 #pragma once
 #include "bms_config.h"
 #include "BMSModule.h"
+#include "BMSPackSnapshot.h"
 
 class BMSModuleManager
 {
@@ -14,6 +15,7 @@ public:
     void sleepBoards();
     void wakeBoards();
     void getAllVoltTemp();
+    void updatePackStats();
     void readSetpoints();
     void setBatteryID(int id);
     void setPstrings(int Pstrings);
@@ -23,6 +25,9 @@ public:
     void setBalanceV(float newVal);
     void setBalanceHyst(float newVal);
     void setSensors(int sensor,float Ignore);
+    void setPollCycles(int temps, int status);
+    void setCapture(bool enabled);
+    bool isCapturing();
     float getPackVoltage();
     float getAvgTemperature();
     float getAvgCellVolt();
@@ -35,21 +40,39 @@ public:
     */
     void printPackSummary();
     void printPackDetails();
+    void printLinkStats();
+    const BMSPackSnapshot &getSnapshot();
+    const BMSPackAggregate &getPackStats();
+    int getLowCellModule();
+    int getHighCellModule();
     
 
 private:
     float packVolt;                         // All modules added together
     int Pstring;
-    float LowCellVolt;
-    float HighCellVolt;
     float lowestPackVolt;
     float highestPackVolt;
     float lowestPackTemp;
     float highestPackTemp;
     BMSModule modules[MAX_MODULE_ADDR + 1]; // store data for as many modules as we've configured for.
+    BMSPackSnapshot snapshot;               // Cells and temperatures of the existing modules as of the last scan
+    BMSPackAggregate packStats;             // Statistics of that snapshot, what the pack wide getters return
     int batteryID;
     int numFoundModules;                    // The number of modules that seem to exist
+    uint8_t activeModules[MAX_MODULE_ADDR]; // Their addresses in ascending order, numFoundModules of them
+    int assignedModules;                    // Addresses setupBoards handed out since the last renumber
     bool isFaulted;
+    uint32_t pollCount;                     // Number of getAllVoltTemp calls, drives the slower poll tiers
+    int tempPollCycles;                     // Read temperatures every this many scans
+    int statusPollCycles;                   // Read alert/fault status every this many scans
+    bool capture;                           // Print every scan for host/bmsreplay
+    uint32_t captureMark;                   // BMSTrace::getTotal() up to which the scan's frames are printed
+    uint32_t captureLost;                   // Frames of this scan overwritten in the trace before printing
+    void startConversions();
+    void setActive(int address, bool active);
+    void startCapture(uint32_t scanStart, uint32_t scanPoll, bool faultLine);
+    void drainCapture(bool all);
+    void endCapture();
     /*
     void sendBatterySummary();
     void sendModuleSummary(int module);
@@ -0,0 +1,166 @@
+#include "BMSPackSnapshot.h"
+
+BMSPackSnapshot::BMSPackSnapshot()
+{
+    clear();
+}
+
+void BMSPackSnapshot::clear()
+{
+    modules = 0;
+}
+
+void BMSPackSnapshot::addModule(BMSModule &module)
+{
+    if (modules >= MAX_MODULE_ADDR) return;
+    uint16_t ignore = module.getIgnoreCellRaw();
+    for (int i = 0; i < 6; i++)
+    {
+        uint16_t raw = module.getCellRaw(i);
+        cells[modules * 6 + i] = (raw > ignore) ? raw : 0;
+    }
+    temps[modules * 2] = module.getTemperatureCenti(0);
+    temps[modules * 2 + 1] = module.getTemperatureCenti(1);
+    moduleTemps[modules] = module.getAvgTempCenti();
+    moduleVolts[modules] = module.getModuleRaw();
+    addresses[modules] = module.getAddress();
+    modules++;
+}
+
+int BMSPackSnapshot::getModuleCount() const
+{
+    return modules;
+}
+
+int BMSPackSnapshot::getCellCount() const
+{
+    return modules * 6;
+}
+
+int BMSPackSnapshot::getAddress(int position) const
+{
+    if (position < 0 || position >= modules) return 0;
+    return addresses[position];
+}
+
+int BMSPackSnapshot::cellModule(int cell) const
+{
+    if (cell < 0) return 0;
+    return getAddress(cell / 6);
+}
+
+void BMSPackSnapshot::cellStats(BMSPackStat &out) const
+{
+    statsU16(cells, modules * 6, out);
+}
+
+void BMSPackSnapshot::tempStats(BMSPackStat &out) const
+{
+    statsI16(temps, modules * 2, out);
+}
+
+void BMSPackSnapshot::moduleTempStats(BMSPackStat &out) const
+{
+    statsI16(moduleTemps, modules, out);
+}
+
+uint32_t BMSPackSnapshot::moduleVoltSum() const
+{
+    uint32_t sum = 0;
+    for (int i = 0; i < modules; i++) sum += moduleVolts[i];
+    return sum;
+}
+
+/*
+ * All of the pack statistics after a scan. The per module part is one walk over the cells, six at a
+ * time.
+ */
+void BMSPackSnapshot::aggregate(BMSPackAggregate &out) const
+{
+    cellStats(out.cells);
+    tempStats(out.temps);
+    moduleTempStats(out.moduleTemps);
+    out.moduleVoltSum = moduleVoltSum();
+    out.deltaMax = 0;
+    out.deltaArg = -1;
+    for (int m = 0; m < modules; m++)
+    {
+        uint16_t low = 0xFFFF, high = 0;
+        for (int i = m * 6; i < m * 6 + 6; i++)
+        {
+            if (cells[i] != 0 && cells[i] < low) low = cells[i];
+            if (cells[i] > high) high = cells[i];
+        }
+        out.moduleLow[m] = low;
+        out.moduleHigh[m] = high;
+        if (low != 0xFFFF && (out.deltaArg < 0 || high - low > out.deltaMax))
+        {
+            out.deltaMax = high - low;
+            out.deltaArg = m;
+        }
+    }
+}
+
+/*
+ * The first pass is written with masks rather than conditions so GCC sees plain min/max/sum
+ * reductions it can vectorise, the second finds the first position of each extreme.
+ */
+static void findExtremes(const uint16_t *values, int n, BMSPackStat &out)
+{
+    out.argmin = out.argmax = -1;
+    if (out.count == 0) return;
+    for (int i = 0; i < n; i++) if (values[i] == out.min) { out.argmin = i; break; }
+    for (int i = 0; i < n; i++) if (values[i] == out.max) { out.argmax = i; break; }
+}
+
+static void findExtremes(const int16_t *values, int n, BMSPackStat &out)
+{
+    out.argmin = out.argmax = -1;
+    if (out.count == 0) return;
+    for (int i = 0; i < n; i++) if (values[i] == out.min) { out.argmin = i; break; }
+    for (int i = 0; i < n; i++) if (values[i] == out.max) { out.argmax = i; break; }
+}
+
+//Cell counts, 0 = ignored. The maximum takes every cell, like BMSModule::getHighCellV.
+void BMSPackSnapshot::statsU16(const uint16_t *values, int n, BMSPackStat &out)
+{
+    uint32_t low = 0xFFFF, high = 0, sum = 0, count = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        uint32_t v = values[i];
+        uint32_t ignored = -(uint32_t)(v == 0);    //all ones for an ignored cell
+        uint32_t counted = v | (0xFFFF & ignored);
+        low = (counted < low) ? counted : low;
+        high = (v > high) ? v : high;
+        sum += v;
+        count += 1 + ignored;
+    }
+    out.min = low;
+    out.max = high;
+    out.sum = sum;
+    out.count = count;
+    findExtremes(values, n, out);
+}
+
+//Temperatures, TEMP_CENTI_INVALID and anything at or below -70C (no sensor fitted) are left out
+void BMSPackSnapshot::statsI16(const int16_t *values, int n, BMSPackStat &out)
+{
+    int32_t low = 32767, high = -32768, sum = 0, count = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        int32_t v = values[i];
+        int32_t valid = -(int32_t)(v > -7000);     //all ones for a counted value
+        int32_t counted = (v & valid) | (32767 & ~valid);
+        low = (counted < low) ? counted : low;
+        high = (v > high) ? v : high;
+        sum += v & valid;
+        count -= valid;
+    }
+    out.min = low;
+    out.max = high;
+    out.sum = sum;
+    out.count = count;
+    findExtremes(values, n, out);
+}
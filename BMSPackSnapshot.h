@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+#include "bms_config.h"
+#include "BMSModule.h"
+
+#define PACK_MAX_CELLS  (MAX_MODULE_ADDR * 6)
+#define PACK_MAX_TEMPS  (MAX_MODULE_ADDR * 2)
+
+//Result of a stats kernel. Indexes are positions in the snapshot arrays, -1 when nothing counted.
+struct BMSPackStat
+{
+    int32_t min;
+    int32_t max;
+    int argmin;                           //first position holding min
+    int argmax;
+    int32_t sum;
+    int count;                            //values that took part
+};
+
+/*
+ * Everything BMSModuleManager reports about the pack, worked out once per scan by
+ * BMSPackSnapshot::aggregate(). Positions are snapshot positions, getAddress() turns them into module
+ * addresses.
+ */
+struct BMSPackAggregate
+{
+    BMSPackStat cells;                    //every counted cell, ADC counts
+    BMSPackStat temps;                    //both sensors of every module, 0.01 degrees C
+    BMSPackStat moduleTemps;              //per module temperature as configured
+    uint32_t moduleVoltSum;               //ADC counts, MODULE_VOLT_LSB
+    uint16_t moduleLow[MAX_MODULE_ADDR];  //lowest counted cell of each module, 0xFFFF if none
+    uint16_t moduleHigh[MAX_MODULE_ADDR];
+    uint16_t deltaMax;                    //widest cell spread inside one module, ADC counts
+    int deltaArg;                         //position of that module, -1 if none
+};
+
+/*
+ * Every cell voltage and temperature of the pack in contiguous arrays, in module order with no gaps
+ * for unused addresses, so the pack statistics are a few flat loops instead of calls into 62 module
+ * objects. Rebuilt from the modules after each scan. Cells at or below a module's ignore level are
+ * stored as 0 and temperatures that did not convert as TEMP_CENTI_INVALID, the kernels leave both out
+ * of minimum, mean and count.
+ *
+ * The kernels are branch free loops over aligned arrays so the compiler can vectorise them where it
+ * has vector instructions to use (SSE/NEON on the host build). GCC for the Xtensa cores does not
+ * generate the S3 PIE instructions, on the board they are tight scalar loops.
+ */
+class BMSPackSnapshot
+{
+public:
+    BMSPackSnapshot();
+    void clear();
+    void addModule(BMSModule &module);
+    int getModuleCount() const;
+    int getCellCount() const;
+    int getAddress(int position) const;   //module address of a position in moduleTemps/moduleVolts
+    int cellModule(int cell) const;       //module address a cell position belongs to
+
+    void cellStats(BMSPackStat &out) const;
+    void tempStats(BMSPackStat &out) const;       //both sensors of every module
+    void moduleTempStats(BMSPackStat &out) const; //per module temperature as configured (settempsensor)
+    uint32_t moduleVoltSum() const;
+    void aggregate(BMSPackAggregate &out) const;
+
+    static void statsU16(const uint16_t *values, int n, BMSPackStat &out);
+    static void statsI16(const int16_t *values, int n, BMSPackStat &out);
+
+    alignas(16) uint16_t cells[PACK_MAX_CELLS];          //ADC counts, CELL_VOLT_LSB
+    alignas(16) int16_t temps[PACK_MAX_TEMPS];           //0.01 degrees C
+    alignas(16) int16_t moduleTemps[MAX_MODULE_ADDR];    //0.01 degrees C
+    alignas(16) uint16_t moduleVolts[MAX_MODULE_ADDR];   //ADC counts, MODULE_VOLT_LSB
+
+private:
+    uint8_t addresses[MAX_MODULE_ADDR];
+    int modules;
+};
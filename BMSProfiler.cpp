@@ -0,0 +1,66 @@
+#include "BMSProfiler.h"
+#include "Logger.h"
+
+BMSProfileStats BMSProfiler::stats[PROF_SLOTS];
+
+static const char *names[PROF_SLOTS] = {"scan", "module read", "pack stats", "balance", "lvgl", "label text"};
+
+void BMSProfiler::add(int slot, uint32_t cycles)
+{
+    BMSProfileStats &s = stats[slot];
+    int bucket = 31 - __builtin_clz(cycles | 1);
+
+    if (s.count == 0 || cycles < s.min) s.min = cycles;
+    if (cycles > s.max) s.max = cycles;
+    s.sum += cycles;
+    s.count++;
+    s.histogram[bucket]++;
+}
+
+/*
+ * One line per slot with times in microseconds, then the histogram buckets that saw anything, each
+ * as <upper bound us>:<count>.
+ */
+void BMSProfiler::print()
+{
+    uint32_t mhz = ESP.getCpuFreqMHz();
+    char line[160];
+    int pos;
+
+    Logger::console("");
+    Logger::console("Stage          Count     Min us    Mean us     Max us   Histogram (<us:count)");
+    for (int i = 0; i < PROF_SLOTS; i++)
+    {
+        const BMSProfileStats &s = stats[i];
+        if (s.count == 0)
+        {
+            snprintf(line, sizeof(line), "%-12s %7i", names[i], 0);
+            SERIALCONSOLE.println(line);
+            continue;
+        }
+        pos = snprintf(line, sizeof(line), "%-12s %7lu %10lu %10lu %10lu  ", names[i], (unsigned long)s.count,
+                       (unsigned long)(s.min / mhz), (unsigned long)(s.sum / s.count / mhz), (unsigned long)(s.max / mhz));
+        for (int b = 0; b < BMS_PROFILE_BUCKETS && pos < (int)sizeof(line) - 1; b++)
+        {
+            if (s.histogram[b] == 0) continue;
+            uint64_t upper = ((2ULL << b) + mhz - 1) / mhz;
+            pos += snprintf(line + pos, sizeof(line) - pos, " <%lu:%lu", (unsigned long)upper, (unsigned long)s.histogram[b]);
+        }
+        SERIALCONSOLE.println(line);
+    }
+}
+
+void BMSProfiler::reset()
+{
+    memset(stats, 0, sizeof(stats));
+}
+
+const BMSProfileStats &BMSProfiler::getStats(int slot)
+{
+    return stats[slot];
+}
+
+void BMSProfiler::setStats(int slot, const BMSProfileStats &saved)
+{
+    stats[slot] = saved;
+}
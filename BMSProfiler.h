@@ -0,0 +1,64 @@
+#pragma once
+
+#include <Arduino.h>
+#include "bms_config.h"
+
+#define BMS_PROFILE_BUCKETS  32   //log2 of the cycle count, bucket n holds 2^n .. 2^(n+1)-1 cycles
+
+//What gets timed. Keep names[] in BMSProfiler.cpp in the same order.
+enum BMSProfileSlot
+{
+    PROF_SCAN,          //BMSModuleManager::getAllVoltTemp, the whole pack scan
+    PROF_MODULE_READ,   //one module's reads inside the scan
+    PROF_PACK_STATS,    //updatePackStats, the pack sums and status text
+    PROF_BALANCE,       //BMSModuleManager::balanceCells
+    PROF_UI,            //lv_timer_handler in loop()
+    PROF_LABEL,         //building and setting the BMS label text in loop()
+    PROF_SLOTS
+};
+
+struct BMSProfileStats
+{
+    uint32_t count;
+    uint32_t min;                         //CPU cycles
+    uint32_t max;
+    uint64_t sum;
+    uint32_t histogram[BMS_PROFILE_BUCKETS];
+};
+
+/*
+ * Scoped timers on the CPU cycle counter for the stages of the main loop, so a missed scan deadline
+ * can be pinned on the bus, the UI or string handling. Each slot keeps min/max/mean and a log2
+ * histogram; the console command P prints them and starts over. The counter is per core and wraps
+ * after ~17s at 240MHz, both fine for anything that runs from loop().
+ */
+class BMSProfiler
+{
+public:
+    static void add(int slot, uint32_t cycles);
+    static void print();
+    static void reset();
+    static const BMSProfileStats &getStats(int slot);
+    static void setStats(int slot, const BMSProfileStats &saved); //put back what getStats() returned
+
+private:
+    static BMSProfileStats stats[PROF_SLOTS];
+};
+
+class BMSProfileScope
+{
+public:
+    explicit BMSProfileScope(int slot) : slot(slot), start(ESP.getCycleCount()) {}
+    ~BMSProfileScope() { BMSProfiler::add(slot, ESP.getCycleCount() - start); }
+
+private:
+    int slot;
+    uint32_t start;
+};
+
+//Times the rest of the enclosing block
+#if BMS_PROFILER
+#define BMS_PROFILE(slot) BMSProfileScope profileScope(slot)
+#else
+#define BMS_PROFILE(slot)
+#endif
@@ -0,0 +1,94 @@
+#include "BMSReplyParser.h"
+
+BMSReplyParser::BMSReplyParser()
+{
+    begin(0, false, 0, 0);
+}
+
+/*
+ * Arm the parser for a request as it was handed to BMSUtil::sendData (address already shifted,
+ * write bit not yet applied). Frame bytes are stored in buffer, never more than maxLen of them.
+ */
+void BMSReplyParser::begin(const uint8_t *request, bool write, uint8_t *buff, int max)
+{
+    crc.reset();
+    buffer = buff;
+    maxLen = max;
+    length = 0;
+    expectedLength = 0;
+    isWrite = write;
+    expectAddr = request ? request[0] : 0;
+    if (write) expectAddr |= 1;
+    expectReg = request ? request[1] : 0;
+    expectLen = request ? request[2] : 0;
+    state = STATE_ADDR;
+    event = FRAME_PENDING;
+    reason = REJECT_NONE;
+}
+
+BMSReplyParser::Event BMSReplyParser::feed(uint8_t data)
+{
+    switch (state)
+    {
+    case STATE_ADDR:
+        //boards without an address yet answer with the top bit set (0x80 / 0x81)
+        if ((data & 0x7F) != (expectAddr & 0x7F)) return reject(REJECT_ADDRESS);
+        state = STATE_REG;
+        break;
+    case STATE_REG:
+        if (data != expectReg) return reject(REJECT_REGISTER);
+        state = STATE_LEN;
+        break;
+    case STATE_LEN:
+        //length byte for reads, the echoed value for writes. Either way it must match what we sent
+        if (data != expectLen) return reject(REJECT_LENGTH);
+        expectedLength = isWrite ? 4 : data + 4;
+        if (expectedLength > maxLen) return reject(REJECT_OVERFLOW);
+        state = (isWrite || data == 0) ? STATE_CRC : STATE_DATA;
+        break;
+    case STATE_DATA:
+        if (length == expectedLength - 2) state = STATE_CRC;
+        break;
+    case STATE_CRC:
+        if (data != crc.value()) return reject(REJECT_CRC);
+        buffer[length++] = data;
+        state = STATE_DONE;
+        event = FRAME_COMPLETE;
+        return event;
+    case STATE_DONE:
+        //anything after a finished frame is not ours, the caller should have stopped feeding
+        return event;
+    }
+
+    crc.update(data);
+    buffer[length++] = data;
+    return event;
+}
+
+BMSReplyParser::Event BMSReplyParser::reject(RejectReason why)
+{
+    reason = why;
+    state = STATE_DONE;
+    event = FRAME_REJECTED;
+    return event;
+}
+
+BMSReplyParser::Event BMSReplyParser::getEvent()
+{
+    return event;
+}
+
+BMSReplyParser::RejectReason BMSReplyParser::getRejectReason()
+{
+    return reason;
+}
+
+int BMSReplyParser::getLength()
+{
+    return length;
+}
+
+int BMSReplyParser::getExpectedLength()
+{
+    return expectedLength;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include "BMSCrc.h"
+
+/*
+ * Byte at a time parser for replies from the module chain. It is armed with the outstanding
+ * request and checks each byte against it as soon as it arrives, so garbage or a reply to
+ * some other request is thrown out after the first bad byte rather than after a full read.
+ *
+ * Read replies:  addr, register, length, <length data bytes>, CRC
+ * Write replies: addr | 1, register, value, CRC (the write echoed back by the chain)
+ */
+class BMSReplyParser
+{
+public:
+    enum Event
+    {
+        FRAME_PENDING,    //need more bytes
+        FRAME_COMPLETE,   //whole frame received and CRC matches
+        FRAME_REJECTED    //byte did not fit the outstanding request, see getRejectReason()
+    };
+
+    enum RejectReason
+    {
+        REJECT_NONE,
+        REJECT_ADDRESS,
+        REJECT_REGISTER,
+        REJECT_LENGTH,
+        REJECT_OVERFLOW,
+        REJECT_CRC
+    };
+
+    BMSReplyParser();
+    void begin(const uint8_t *request, bool isWrite, uint8_t *buffer, int maxLen);
+    Event feed(uint8_t data);
+    Event getEvent();
+    RejectReason getRejectReason();
+    int getLength();         //bytes of the frame accepted so far
+    int getExpectedLength(); //full frame length once the header is in, 0 before that
+
+private:
+    enum State
+    {
+        STATE_ADDR,
+        STATE_REG,
+        STATE_LEN,
+        STATE_DATA,
+        STATE_CRC,
+        STATE_DONE
+    };
+
+    Event reject(RejectReason reason);
+
+    BMSCRC8 crc;
+    uint8_t *buffer;
+    int maxLen;
+    int length;
+    int expectedLength;
+    uint8_t expectAddr;
+    uint8_t expectReg;
+    uint8_t expectLen;
+    bool isWrite;
+    State state;
+    Event event;
+    RejectReason reason;
+};
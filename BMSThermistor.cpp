@@ -0,0 +1,96 @@
+#include <math.h>
+#include "BMSThermistor.h"
+
+#define THERM_FULL_SCALE  33046.0   //channel 0 count at the reference voltage, the table is in these counts
+#define THERM_STEP_BITS   5         //32 counts between entries, under 0.04C off the formula from -40C to 125C
+#define THERM_SIZE        520       //past the last count where the divider still gives a resistance
+#define THERM_MAX_RAW     16383     //14 bit ADC
+
+//Steinhart-Hart coefficients of the module thermistors
+#define SH_A  0.0007610373573
+#define SH_B  0.0002728524832
+#define SH_C  0.0000001022822735
+
+//Count offset and full scale count of each channel
+static const uint16_t offsets[2] = {2, 9};
+static const uint16_t fullScale[2] = {33046, 33068};
+//channel count to table count in 16.16, 33046 * 65536 / full scale
+static const uint32_t scales[2] = {65536, 65492};
+
+/*
+ * Natural log the compiler can evaluate: bring x into [1, 2) by powers of two, then the atanh
+ * series ln(m) = 2 (y + y^3/3 + y^5/5 ...) with y = (m - 1) / (m + 1) <= 1/3.
+ */
+static constexpr double lnSeries(double y2, double term, int n)
+{
+    return (n > 41) ? 0.0 : term / n + lnSeries(y2, term * y2, n + 2);
+}
+
+static constexpr double lnMantissa(double y)
+{
+    return 2.0 * lnSeries(y * y, y, 1);
+}
+
+static constexpr double ln(double x, int exponent)
+{
+    return (x >= 2.0) ? ln(x / 2.0, exponent + 1) : (x < 1.0) ? ln(x * 2.0, exponent - 1)
+                                                             : lnMantissa((x - 1.0) / (x + 1.0)) + exponent * 0.6931471805599453;
+}
+
+//Thermistor resistance in ohms at a table count, from the divider the module board puts it in
+static constexpr double resistance(int index)
+{
+    return (1.78 / ((index << THERM_STEP_BITS) / THERM_FULL_SCALE) - 3.57) * 1000.0;
+}
+
+static constexpr double celsius(double lnR)
+{
+    return 1.0 / (SH_A + SH_B * lnR + SH_C * lnR * lnR * lnR) - 273.15;
+}
+
+static constexpr int16_t centi(double t)
+{
+    return (t > 300.0 || t < -300.0) ? TEMP_CENTI_INVALID : (int16_t)((t >= 0.0) ? t * 100.0 + 0.5 : t * 100.0 - 0.5);
+}
+
+/*
+ * Below the first step (about -77C) the curve bends too hard to interpolate, only an open thermistor
+ * reads that low anyway. Same for anything over 300C at the other end.
+ */
+static constexpr int16_t thermEntry(int index)
+{
+    return (index == 0) ? TEMP_CENTI_INVALID : (resistance(index) <= 0.0) ? TEMP_CENTI_INVALID : centi(celsius(ln(resistance(index), 0)));
+}
+
+#define THERM_ENTRY4(n)    thermEntry(n), thermEntry(n + 1), thermEntry(n + 2), thermEntry(n + 3)
+#define THERM_ENTRY16(n)   THERM_ENTRY4(n), THERM_ENTRY4(n + 4), THERM_ENTRY4(n + 8), THERM_ENTRY4(n + 12)
+#define THERM_ENTRY64(n)   THERM_ENTRY16(n), THERM_ENTRY16(n + 16), THERM_ENTRY16(n + 32), THERM_ENTRY16(n + 48)
+#define THERM_ENTRY256(n)  THERM_ENTRY64(n), THERM_ENTRY64(n + 64), THERM_ENTRY64(n + 128), THERM_ENTRY64(n + 192)
+
+static_assert(thermEntry(136) > 2500 && thermEntry(136) < 2530, "thermistor table generator is broken"); //~25C
+
+const int16_t BMSThermistor::table[THERM_SIZE] = {
+    THERM_ENTRY256(0), THERM_ENTRY256(256), THERM_ENTRY4(512), THERM_ENTRY4(516)
+};
+
+int16_t BMSThermistor::toCentidegrees(uint16_t raw, int channel)
+{
+    if (raw > THERM_MAX_RAW) return TEMP_CENTI_INVALID;
+
+    uint32_t pos = (raw + offsets[channel]) * scales[channel];
+    uint32_t index = pos >> (16 + THERM_STEP_BITS);
+    int32_t frac = (pos >> THERM_STEP_BITS) & 0xFFFF;
+    int32_t low = table[index];
+    int32_t high = table[index + 1];
+
+    if (low == TEMP_CENTI_INVALID || high == TEMP_CENTI_INVALID) return TEMP_CENTI_INVALID;
+    return low + (((high - low) * frac) >> 16);
+}
+
+float BMSThermistor::steinhartHart(uint16_t raw, int channel)
+{
+    float tempTemp = (1.78f / ((raw + offsets[channel]) / (float)fullScale[channel]) - 3.57f);
+    tempTemp *= 1000.0f;
+    float tempCalc = 1.0f / (0.0007610373573f + (0.0002728524832 * logf(tempTemp)) + (powf(logf(tempTemp), 3) * 0.0000001022822735f));
+    return tempCalc - 273.15f;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+#define TEMP_CENTI_INVALID  -32768  //temperature that did not convert (open or shorted thermistor)
+
+/*
+ * Thermistor inputs of the bq76PL536 to hundredths of a degree C. The Steinhart-Hart curve is
+ * folded into a table at compile time, indexed by the ADC count scaled to channel 0, with linear
+ * interpolation between entries. Both channels keep their own offset and full scale count.
+ */
+class BMSThermistor
+{
+public:
+    static int16_t toCentidegrees(uint16_t raw, int channel);
+
+    //The original logf/powf conversion. Only kept as the reference for benchmarks and checks.
+    static float steinhartHart(uint16_t raw, int channel);
+
+private:
+    static const int16_t table[];
+};
@@ -0,0 +1,86 @@
+#include <Arduino.h>
+#include "bms_config.h"
+#include "BMSTrace.h"
+
+BMSTraceEntry BMSTrace::entries[BMS_TRACE_ENTRIES];
+uint16_t BMSTrace::head = 0;
+uint16_t BMSTrace::count = 0;
+uint32_t BMSTrace::total = 0;
+
+void BMSTrace::record(uint8_t direction, const uint8_t *data, int len, uint8_t outcome)
+{
+    BMSTraceEntry &entry = entries[head];
+    int keep = (len < BMS_TRACE_MAX_BYTES) ? len : BMS_TRACE_MAX_BYTES;
+
+    entry.timestamp = micros();
+    entry.direction = direction;
+    entry.outcome = outcome;
+    entry.length = (len > 255) ? 255 : len;
+    memcpy(entry.bytes, data, keep);
+
+    head = (head + 1) % BMS_TRACE_ENTRIES;
+    if (count < BMS_TRACE_ENTRIES) count++;
+    total++;
+}
+
+/*
+ * One line per frame, oldest first:  <T|R> <timestamp us> <outcome> <length> <hex bytes>
+ * framed by TRACE BEGIN / TRACE END so the decoder can pick it out of a console log.
+ */
+void BMSTrace::dump()
+{
+    char line[BMS_TRACE_LINE];
+    int first = (head + BMS_TRACE_ENTRIES - count) % BMS_TRACE_ENTRIES;
+
+    SERIALCONSOLE.print("TRACE BEGIN ");
+    SERIALCONSOLE.println(count);
+    for (int i = 0; i < count; i++)
+    {
+        format(entries[(first + i) % BMS_TRACE_ENTRIES], line, sizeof(line));
+        SERIALCONSOLE.println(line);
+    }
+    SERIALCONSOLE.println("TRACE END");
+}
+
+//Writes the dump() line of one entry, BMS_TRACE_LINE characters are always enough. Returns its length.
+int BMSTrace::format(const BMSTraceEntry &entry, char *line, int size)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    int keep = (entry.length < BMS_TRACE_MAX_BYTES) ? entry.length : BMS_TRACE_MAX_BYTES;
+    if (size <= 0) return 0;
+    int pos = snprintf(line, size, "%c %lu %u %u ", entry.direction == BMS_TRACE_TX ? 'T' : 'R',
+                       (unsigned long)entry.timestamp, entry.outcome, entry.length);
+
+    if (pos < 0) pos = 0;
+    if (pos >= size) pos = size - 1; //header was cut off, snprintf returned the length it wanted
+    for (int x = 0; x < keep && pos + 3 <= size; x++)
+    {
+        line[pos++] = hex[entry.bytes[x] >> 4];
+        line[pos++] = hex[entry.bytes[x] & 0xF];
+    }
+    line[pos] = 0;
+    return pos;
+}
+
+void BMSTrace::clear()
+{
+    head = 0;
+    count = 0;
+}
+
+int BMSTrace::getCount()
+{
+    return count;
+}
+
+bool BMSTrace::getEntry(int index, BMSTraceEntry &entry)
+{
+    if (index < 0 || index >= count) return false;
+    entry = entries[(head + BMS_TRACE_ENTRIES - count + index) % BMS_TRACE_ENTRIES];
+    return true;
+}
+
+uint32_t BMSTrace::getTotal()
+{
+    return total;
+}
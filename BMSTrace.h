@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+#define BMS_TRACE_ENTRIES    256  //frames kept in RAM, oldest are overwritten (~8KB)
+#define BMS_TRACE_MAX_BYTES  24   //enough for the largest reply (GPAI block, 22 bytes)
+#define BMS_TRACE_LINE       (24 + BMS_TRACE_MAX_BYTES * 2) //format() output including the terminator
+
+#define BMS_TRACE_TX         0
+#define BMS_TRACE_RX         1
+
+#define BMS_TRACE_RAW        0xFF //outcome of replies read without the parser (BMSUtil::getReply)
+
+/*
+ * Always on recorder of the traffic on the module bus. Every frame sent and every reply (or the
+ * lack of one) lands in a RAM ring buffer with a microsecond timestamp, so there is something to
+ * look at when the chain misbehaves in the field without the timing changes of debug logging.
+ * dump() prints it on the console; host/bmstrace.cpp turns that into readable transactions.
+ */
+struct BMSTraceEntry
+{
+    uint32_t timestamp;                   //micros() when the frame was sent / the reply was done
+    uint8_t direction;                    //BMS_TRACE_TX or BMS_TRACE_RX
+    uint8_t outcome;                      //BMSUtil::Result for replies, 0 for requests
+    uint8_t length;                       //bytes on the wire (only the first BMS_TRACE_MAX_BYTES are kept)
+    uint8_t bytes[BMS_TRACE_MAX_BYTES];
+};
+
+class BMSTrace
+{
+public:
+    static void record(uint8_t direction, const uint8_t *data, int len, uint8_t outcome);
+    static void dump();
+    static void clear();
+    static int getCount();
+    static bool getEntry(int index, BMSTraceEntry &entry); //0 is the oldest entry still held
+    static uint32_t getTotal();                            //frames recorded since boot, never goes back
+    static int format(const BMSTraceEntry &entry, char *line, int size);
+
+private:
+    static BMSTraceEntry entries[BMS_TRACE_ENTRIES];
+    static uint16_t head;                 //next entry to write
+    static uint16_t count;
+    static uint32_t total;
+};
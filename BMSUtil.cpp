@@ -0,0 +1,145 @@
+#include "bms_config.h"
+#include "BMSUtil.h"
+#include "BMSReplyParser.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+//Number of idle symbols on the RX line before the UART driver raises its RX timeout event.
+//One symbol is ~16us at 612500 baud so a reply is handed over almost as soon as it ends.
+#define BMS_RX_TIMEOUT_SYMBOLS  1
+//Hand bytes over every few bytes while a reply is streaming in so the parser can reject a bad
+//header early instead of only seeing the frame once the line goes idle.
+#define BMS_RX_FIFO_FULL        4
+//Quiet time that tells us a rejected frame has finished arriving (a byte is ~16us on the wire)
+#define BMS_IDLE_GAP_US         150
+
+static SemaphoreHandle_t rxEvent = NULL;
+static uint32_t lastLatency = 0;
+static BMSUtil::Result lastResult = BMSUtil::REPLY_OK;
+
+//Runs in the UART event task whenever the driver has bytes for us (FIFO threshold or RX timeout)
+static void onBMSReceive()
+{
+    xSemaphoreGive(rxEvent);
+}
+
+void BMSUtil::begin()
+{
+    if (rxEvent != NULL) return;
+    rxEvent = xSemaphoreCreateBinary();
+    SERIALBMS.setRxTimeout(BMS_RX_TIMEOUT_SYMBOLS);
+    SERIALBMS.setRxFIFOFull(BMS_RX_FIFO_FULL);
+    SERIALBMS.onReceive(onBMSReceive);
+}
+
+//Throw away the remainder of a rejected frame so it can't be taken for the reply to a retry
+static void waitForIdle()
+{
+    do
+    {
+        while (SERIALBMS.available()) SERIALBMS.read();
+        delayMicroseconds(BMS_IDLE_GAP_US);
+    } while (SERIALBMS.available());
+}
+
+static void countResult(BMSLinkStats *stats, BMSUtil::Result result, uint32_t latency)
+{
+    stats->attempts++;
+    switch (result)
+    {
+    case BMSUtil::REPLY_OK:
+        if (stats->good == 0 || latency < stats->latencyMin) stats->latencyMin = latency;
+        if (latency > stats->latencyMax) stats->latencyMax = latency;
+        stats->latencySum += latency;
+        stats->good++;
+        break;
+    case BMSUtil::REPLY_TIMEOUT:
+        stats->timeouts++;
+        break;
+    case BMSUtil::REPLY_SHORT:
+        stats->shortFrames++;
+        break;
+    case BMSUtil::REPLY_BAD_HEADER:
+        stats->badFrames++;
+        break;
+    case BMSUtil::REPLY_BAD_CRC:
+        stats->crcErrors++;
+        break;
+    }
+}
+
+int BMSUtil::transact(const BMSFrame &frame, uint8_t *retData, int retLen, BMSLinkStats *stats)
+{
+    //The old code slept this long unconditionally. It is now only the upper bound.
+    uint32_t timeout = 2000 * ((retLen / 8) + 1);
+    uint32_t start, elapsed;
+    BMSReplyParser parser;
+    BMSReplyParser::Event event = BMSReplyParser::FRAME_PENDING;
+    uint8_t raw[BMS_TRACE_MAX_BYTES];   //bytes as they came off the wire, for the bus trace
+    int rawLen = 0;
+    int numBytes;
+    uint8_t c;
+
+    if (rxEvent == NULL) begin();
+
+    //anything still sitting in the buffer belongs to an earlier, truncated reply
+    while (SERIALBMS.available()) SERIALBMS.read();
+    xSemaphoreTake(rxEvent, 0);
+
+    parser.begin(frame.bytes, frame.isWrite, retData, retLen);
+    sendFrame(frame);
+    start = micros();
+
+    while (1 == 1)
+    {
+        while (event == BMSReplyParser::FRAME_PENDING && SERIALBMS.available())
+        {
+            c = SERIALBMS.read();
+            if (rawLen < BMS_TRACE_MAX_BYTES) raw[rawLen] = c;
+            rawLen++;
+            event = parser.feed(c);
+        }
+        if (event != BMSReplyParser::FRAME_PENDING) break;
+        elapsed = micros() - start;
+        if (elapsed >= timeout) break;
+        //sleep until the driver signals more data, the CPU is free for the UI in the meantime
+        xSemaphoreTake(rxEvent, pdMS_TO_TICKS((timeout - elapsed) / 1000) + 1);
+    }
+    lastLatency = micros() - start;
+    numBytes = parser.getLength();
+
+    if (event == BMSReplyParser::FRAME_COMPLETE) lastResult = REPLY_OK;
+    else if (event == BMSReplyParser::FRAME_PENDING) lastResult = (numBytes == 0) ? REPLY_TIMEOUT : REPLY_SHORT;
+    else
+    {
+        lastResult = (parser.getRejectReason() == BMSReplyParser::REJECT_CRC) ? REPLY_BAD_CRC : REPLY_BAD_HEADER;
+        waitForIdle();
+        Logger::debug("Reply rejected after %i bytes, reason %i", numBytes, parser.getRejectReason());
+    }
+    if (stats) countResult(stats, lastResult, lastLatency);
+    BMSTrace::record(BMS_TRACE_RX, raw, rawLen, lastResult);
+
+    if (Logger::isDebug())
+    {
+        SERIALCONSOLE.print("Reply (");
+        SERIALCONSOLE.print(lastLatency);
+        SERIALCONSOLE.print("us): ");
+        for (int x = 0; x < numBytes; x++) {
+            SERIALCONSOLE.print(retData[x], HEX);
+            SERIALCONSOLE.print(" ");
+        }
+        SERIALCONSOLE.println();
+    }
+
+    return numBytes;
+}
+
+uint32_t BMSUtil::getLastLatency()
+{
+    return lastLatency;
+}
+
+BMSUtil::Result BMSUtil::getLastResult()
+{
+    return lastResult;
+}
@@ -1,58 +1,50 @@
+#pragma once
+
 #include <Arduino.h>
 #include "Logger.h"
+#include "BMSCrc.h"
+#include "BMSFrame.h"
+#include "BMSLinkStats.h"
+#include "BMSTrace.h"
 
 class BMSUtil {    
 public:
+    enum Result
+    {
+        REPLY_OK,
+        REPLY_TIMEOUT,     //no reply at all
+        REPLY_SHORT,       //reply stopped before the frame was complete
+        REPLY_BAD_HEADER,  //reply did not belong to our request
+        REPLY_BAD_CRC
+    };
     
     static uint8_t genCRC(uint8_t *input, int lenInput)
     {
-        uint8_t generator = 0x07;
-        uint8_t crc = 0;
-  
-        for (int x = 0; x < lenInput; x++)
-        {
-            crc ^= input[x]; /* XOR-in the next input byte */
-
-            for (int i = 0; i < 8; i++)
-            {
-                if ((crc & 0x80) != 0)
-                {
-                    crc = (uint8_t)((crc << 1) ^ generator);
-                }
-                else
-                {
-                    crc <<= 1;
-                }
-            }
-        }
+        return BMSCRC8::compute(input, lenInput);
+    }
 
-        return crc;
+    static void sendData(const uint8_t *data, uint8_t dataLen, bool isWrite)
+    {
+        BMSFrame frame;
+        frame.build(data, dataLen, isWrite);  //assumes that there are at least 2 bytes sent every time. There should be, addr and cmd at the least.
+        sendFrame(frame);
     }
 
-    static void sendData(uint8_t *data, uint8_t dataLen, bool isWrite)
+    //One write call for the whole frame, the driver copies it to its TX buffer and returns
+    static void sendFrame(const BMSFrame &frame)
     {
-        uint8_t orig = data[0];
-        uint8_t addrByte = data[0];
-        if (isWrite) addrByte |= 1;
-        SERIALBMS.write(addrByte);
-        SERIALBMS.write(&data[1], dataLen - 1);  //assumes that there are at least 2 bytes sent every time. There should be, addr and cmd at the least.
-        data[0] = addrByte;
-        if (isWrite) SERIALBMS.write(genCRC(data, dataLen));        
+        SERIALBMS.write(frame.bytes, frame.length);
+        BMSTrace::record(BMS_TRACE_TX, frame.bytes, frame.length, 0);
 
         if (Logger::isDebug())
         {
             SERIALCONSOLE.print("Sending: ");
-            SERIALCONSOLE.print(addrByte, HEX);
-            SERIALCONSOLE.print(" ");
-            for (int x = 1; x < dataLen; x++) {
-                SERIALCONSOLE.print(data[x], HEX);
+            for (int x = 0; x < frame.length; x++) {
+                SERIALCONSOLE.print(frame.bytes[x], HEX);
                 SERIALCONSOLE.print(" ");
             }
-            if (isWrite) SERIALCONSOLE.print(genCRC(data, dataLen), HEX);
             SERIALCONSOLE.println();
         }
-        
-        data[0] = orig;
     }
 
     static int getReply(uint8_t *data, int maxLen)
@@ -72,22 +64,45 @@ public:
         {
             while (SERIALBMS.available()) SERIALBMS.read();
         }
+        BMSTrace::record(BMS_TRACE_RX, data, numBytes, BMS_TRACE_RAW);
         if (Logger::isDebug()) SERIALCONSOLE.println();
         return numBytes;
     }
     
+    //Hooks the UART receive event so transactions can sleep until reply bytes show up instead
+    //of guessing with delay(). Safe to call more than once; transact() calls it if needed.
+    static void begin();
+
+    //Sends a request and blocks (without burning CPU) until a reply matching it has been parsed,
+    //a bad byte got it rejected or the transaction timed out. retLen is the full reply length
+    //(read: bytes requested + 4, write: 4). Returns the number of good reply bytes received so
+    //anything short of retLen is a failure. The outcome is counted in stats if one is given.
+    static int transact(const uint8_t *data, uint8_t dataLen, bool isWrite, uint8_t *retData, int retLen, BMSLinkStats *stats = NULL)
+    {
+        BMSFrame frame;
+        frame.build(data, dataLen, isWrite);
+        return transact(frame, retData, retLen, stats);
+    }
+    static int transact(const BMSFrame &frame, uint8_t *retData, int retLen, BMSLinkStats *stats = NULL);
+
+    //Microseconds between the end of the last request and its complete reply (or the timeout)
+    static uint32_t getLastLatency();
+
+    //How the last transaction ended
+    static Result getLastResult();
+
     //Uses above functions to send data then get the response. Will auto retry if response not 
     //the expected return length. This helps to alleviate any comm issues. The Due cannot exactly
     //match the correct comm speed so sometimes there are data glitches.
-    static int sendDataWithReply(uint8_t *data, uint8_t dataLen, bool isWrite, uint8_t *retData, int retLen)
+    static int sendDataWithReply(const uint8_t *data, uint8_t dataLen, bool isWrite, uint8_t *retData, int retLen, BMSLinkStats *stats = NULL)
     {
+        BMSFrame frame;
         int attempts = 1;
         int returnedLength;
+        frame.build(data, dataLen, isWrite); //built once, every retry sends the same buffer
         while (attempts < 4)
         {
-            sendData(data, dataLen, isWrite);
-            delay(2 * ((retLen / 8) + 1));
-            returnedLength = getReply(retData, retLen);
+            returnedLength = transact(frame, retData, retLen, stats);
             if (returnedLength == retLen) return returnedLength;
             attempts++;
         }
@@ -0,0 +1,302 @@
+#include <Arduino.h>
+#include <new>
+#include "Benchmark.h"
+#include "BMSCrc.h"
+#include "BMSModule.h"
+#include "BMSModuleManager.h"
+#include "BMSPackSnapshot.h"
+#include "BMSThermistor.h"
+#include "BMSProfiler.h"
+#include "HeapMonitor.h"
+#include "Logger.h"
+
+#if BMS_BENCHMARK
+
+#define BENCH_ITERATIONS      2000
+#define BENCH_AGG_ITERATIONS  200   //pack wide loops, a lot slower per call on a full chain
+
+//A full GPAI block reply as a module sends it: 14.5V module, cells around 3.13V, both sensors ~26C
+static const uint8_t gpaiReply[22] = {0x02, 0x01, 0x12, 0x1B, 0xD8, 0x20, 0x13, 0x20, 0x1C, 0x20, 0x0A,
+                                      0x20, 0x17, 0x20, 0x0E, 0x20, 0x12, 0x11, 0x8D, 0x11, 0x86, 0x7E};
+
+//Swallows log output so only the formatting is timed, not the UART
+class NullPrint : public Print
+{
+public:
+    size_t write(uint8_t c) { return 1; }
+    size_t write(const uint8_t *buffer, size_t size) { return size; }
+};
+
+void Benchmark::run(BMSModuleManager &bms)
+{
+    Logger::LogLevel level = Logger::getLogLevel();
+    Logger::setLoglevel(Logger::Off); //debug output inside the timed code would swamp the numbers
+    crc();
+    decode();
+    thermistor();
+    aggregate(bms);
+    snapshot();
+    logging();
+    Logger::setLoglevel(level);
+}
+
+void Benchmark::report(const char *name, int iterations, uint32_t cycles)
+{
+    Logger::console("BENCH,%s,%i,%i", name, iterations, (int)(cycles / iterations));
+}
+
+/*
+ * Compare the table driven CRC against the original bitwise loop over a full GPAI reply
+ * (address, register, length and 18 data bytes - the largest frame we check)
+ */
+void Benchmark::crc()
+{
+    uint8_t frame[21] = {0x02, 0x01, 0x12, 0x2E, 0x4C, 0x20, 0xA8, 0x20, 0xB1, 0x20, 0x9F,
+                         0x20, 0xAC, 0x20, 0xA3, 0x20, 0xA7, 0x5A, 0x31, 0x5A, 0x0C};
+    volatile uint8_t sink = 0;
+    uint32_t start, bitwise, table;
+
+    if (BMSCRC8::compute(frame, 21) != BMSCRC8::computeBitwise(frame, 21))
+    {
+        Logger::error("CRC implementations disagree!");
+        return;
+    }
+
+    start = ESP.getCycleCount();
+    for (int i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        frame[20] = i; //keep the compiler from hoisting the call out of the loop
+        sink = sink + BMSCRC8::computeBitwise(frame, 21);
+    }
+    bitwise = ESP.getCycleCount() - start;
+
+    start = ESP.getCycleCount();
+    for (int i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        frame[20] = i;
+        sink = sink + BMSCRC8::compute(frame, 21);
+    }
+    table = ESP.getCycleCount() - start;
+
+    Logger::console("CRC-8 over 21 bytes: bitwise %i cycles, table %i cycles (%fx faster)",
+                    (int)(bitwise / BENCH_ITERATIONS), (int)(table / BENCH_ITERATIONS), (float)bitwise / table);
+    report("crc_bitwise", BENCH_ITERATIONS, bitwise);
+    report("crc_table", BENCH_ITERATIONS, table);
+}
+
+/*
+ * Turning a GPAI reply into volts, with and without the two temperature conversions
+ */
+void Benchmark::decode()
+{
+    BMSModule module;
+    uint8_t reply[22];
+    uint32_t start, cells, temps;
+
+    memcpy(reply, gpaiReply, sizeof(reply));
+    module.setIgnoreCell(0.0f);
+
+    start = ESP.getCycleCount();
+    for (int i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        reply[6] = i; //low byte of cell 1
+        module.decodeADCValues(reply, false);
+    }
+    cells = ESP.getCycleCount() - start;
+
+    start = ESP.getCycleCount();
+    for (int i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        reply[18] = 0x80 + (i & 0x0F); //low byte of temperature 1
+        module.decodeADCValues(reply, true);
+    }
+    temps = ESP.getCycleCount() - start;
+
+    Logger::console("GPAI decode: cells %i cycles, cells + temperatures %i cycles",
+                    (int)(cells / BENCH_ITERATIONS), (int)(temps / BENCH_ITERATIONS));
+    report("decode_cells", BENCH_ITERATIONS, cells);
+    report("decode_temps", BENCH_ITERATIONS, temps);
+}
+
+/*
+ * The thermistor table against the Steinhart-Hart formula it replaced: worst difference over every
+ * 14 bit count of both channels (the -40C to 125C cell range and all of the range the table covers),
+ * and the time per conversion of each.
+ */
+void Benchmark::thermistor()
+{
+    volatile int32_t sink = 0;
+    volatile float fsink = 0.0f;
+    float worstRange = 0.0f, worstAll = 0.0f, error;
+    int16_t lowest = 32767, highest = -32767;
+    uint32_t start, formula, table;
+
+    for (int channel = 0; channel < 2; channel++)
+    {
+        for (uint16_t raw = 0; raw <= 16383; raw++)
+        {
+            float want = BMSThermistor::steinhartHart(raw, channel);
+            int16_t got = BMSThermistor::toCentidegrees(raw, channel);
+            if (got == TEMP_CENTI_INVALID) continue;
+            if (!(want > -300.0f && want < 300.0f))
+            {
+                Logger::error("Thermistor table gives %iC where the formula has no temperature", got / 100);
+                return;
+            }
+            if (got < lowest) lowest = got;
+            if (got > highest) highest = got;
+            error = fabsf(got * 0.01f - want);
+            if (error > worstAll) worstAll = error;
+            if (want >= -40.0f && want <= 125.0f && error > worstRange) worstRange = error;
+        }
+    }
+
+    start = ESP.getCycleCount();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) fsink = fsink + BMSThermistor::steinhartHart(4000 + i, i & 1);
+    formula = ESP.getCycleCount() - start;
+
+    start = ESP.getCycleCount();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) sink = sink + BMSThermistor::toCentidegrees(4000 + i, i & 1);
+    table = ESP.getCycleCount() - start;
+
+    Logger::console("Thermistor: table covers %fC to %fC, off the formula by %fC max from -40C to 125C, %fC max overall",
+                    lowest * 0.01f, highest * 0.01f, worstRange, worstAll);
+    Logger::console("Thermistor: formula %i cycles, table %i cycles (%fx faster)",
+                    (int)(formula / BENCH_ITERATIONS), (int)(table / BENCH_ITERATIONS), (float)formula / table);
+    report("therm_formula", BENCH_ITERATIONS, formula);
+    report("therm_table", BENCH_ITERATIONS, table);
+}
+
+/*
+ * The pack wide loops run after every scan, over whatever modules the manager has found. The runs of
+ * updatePackStats must not show up in the profiler and heap statistics of the real scans, and the
+ * texts it rebuilds may carry more than it writes (the balancing note), so all of that is put back.
+ */
+void Benchmark::aggregate(BMSModuleManager &bms)
+{
+    extern String bms_status, bms_modules_text;
+    volatile float sink = 0.0f;
+    uint32_t start, stats, low, high;
+    BMSProfileStats profile = BMSProfiler::getStats(PROF_PACK_STATS);
+    HeapSiteStats heap = HeapMonitor::getStats(HEAP_PACK_STATS);
+    String status = bms_status;
+    String modulesText = bms_modules_text;
+
+    start = ESP.getCycleCount();
+    for (int i = 0; i < BENCH_AGG_ITERATIONS; i++) bms.updatePackStats();
+    stats = ESP.getCycleCount() - start;
+
+    BMSProfiler::setStats(PROF_PACK_STATS, profile);
+    HeapMonitor::setStats(HEAP_PACK_STATS, heap);
+    bms_status = status;
+    bms_modules_text = modulesText;
+
+    start = ESP.getCycleCount();
+    for (int i = 0; i < BENCH_AGG_ITERATIONS; i++) sink = sink + bms.getLowCellVolt();
+    low = ESP.getCycleCount() - start;
+
+    start = ESP.getCycleCount();
+    for (int i = 0; i < BENCH_AGG_ITERATIONS; i++) sink = sink + bms.getHighCellVolt();
+    high = ESP.getCycleCount() - start;
+
+    Logger::console("Pack aggregation: pack stats + texts %i cycles, low cell %i cycles, high cell %i cycles",
+                    (int)(stats / BENCH_AGG_ITERATIONS), (int)(low / BENCH_AGG_ITERATIONS), (int)(high / BENCH_AGG_ITERATIONS));
+    report("pack_stats", BENCH_AGG_ITERATIONS, stats);
+    report("low_cell", BENCH_AGG_ITERATIONS, low);
+    report("high_cell", BENCH_AGG_ITERATIONS, high);
+}
+
+/*
+ * The pack statistics kernels over a full chain (62 modules, 372 cells, 124 sensors) whatever is
+ * connected: cell min/max/argmin/argmax/sum, the same for the temperatures, and both together.
+ */
+void Benchmark::snapshot()
+{
+    BMSPackSnapshot *full = new (std::nothrow) BMSPackSnapshot; //too big for the loop task stack, only held while it runs
+    BMSModule module;
+    BMSPackStat stat;
+    uint8_t reply[22];
+    volatile int32_t sink = 0;
+    uint32_t start, cells, temps;
+
+    if (!full)
+    {
+        Logger::error("Not enough heap for the pack snapshot benchmark");
+        return;
+    }
+    BMSPackSnapshot &pack = *full;
+    memcpy(reply, gpaiReply, sizeof(reply));
+    module.setIgnoreCell(0.0f);
+    pack.clear();
+    for (int m = 0; m < MAX_MODULE_ADDR; m++)
+    {
+        for (int c = 0; c < 6; c++) reply[6 + c * 2] = m * 6 + c; //low byte of each cell
+        module.setAddress(m + 1);
+        module.decodeADCValues(reply, true);
+        pack.addModule(module);
+    }
+
+    start = ESP.getCycleCount();
+    for (int i = 0; i < BENCH_AGG_ITERATIONS; i++)
+    {
+        pack.cellStats(stat);
+        sink = sink + stat.argmin;
+    }
+    cells = ESP.getCycleCount() - start;
+
+    start = ESP.getCycleCount();
+    for (int i = 0; i < BENCH_AGG_ITERATIONS; i++)
+    {
+        pack.tempStats(stat);
+        sink = sink + stat.argmax;
+    }
+    temps = ESP.getCycleCount() - start;
+
+    Logger::console("Pack snapshot, %i cells: cell stats %i cycles, temperature stats %i cycles", pack.getCellCount(),
+                    (int)(cells / BENCH_AGG_ITERATIONS), (int)(temps / BENCH_AGG_ITERATIONS));
+    report("snapshot_cells", BENCH_AGG_ITERATIONS, cells);
+    report("snapshot_temps", BENCH_AGG_ITERATIONS, temps);
+    delete full;
+}
+
+/*
+ * Formatting one pack summary line, and a debug message that is filtered out by the log level
+ */
+void Benchmark::logging()
+{
+    NullPrint sink;
+    Logger::LogLevel level = Logger::getLogLevel();
+    uint32_t start, format, filtered;
+
+    Logger::setOutput(&sink);
+    start = ESP.getCycleCount();
+    for (int i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        Logger::console("  Voltage: %fV   (%fV-%fV)     Temperatures: (%fC-%fC)", 22.5f, 3.712f, 3.761f, 21.5f, i * 0.01f);
+    }
+    format = ESP.getCycleCount() - start;
+    Logger::setOutput(NULL);
+
+    Logger::setLoglevel(Logger::Info);
+    start = ESP.getCycleCount();
+    for (int i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        Logger::debug("Module %i exists. Reading voltage and temperature values", i);
+    }
+    filtered = ESP.getCycleCount() - start;
+    Logger::setLoglevel(level);
+
+    Logger::console("Logger: formatted line %i cycles, filtered debug %i cycles",
+                    (int)(format / BENCH_ITERATIONS), (int)(filtered / BENCH_ITERATIONS));
+    report("log_format", BENCH_ITERATIONS, format);
+    report("log_filtered", BENCH_ITERATIONS, filtered);
+}
+
+#else
+
+void Benchmark::run(BMSModuleManager &bms)
+{
+    Logger::console("Benchmarks are not built in, set BMS_BENCHMARK in bms_config.h");
+}
+
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+class BMSModuleManager;
+
+/*
+ * Small microbenchmarks of the acquisition hot paths, run from the serial console on the target or
+ * by host/microbench on a PC. Timings are in CPU cycles so they can be compared across clock
+ * settings. Besides the readable output every result is printed as
+ *   BENCH,<name>,<iterations>,<cycles per operation>
+ * so scripts can pick the numbers out of a console log and compare firmware versions.
+ * With BMS_BENCHMARK set to 0 only run() is left, and it just says so.
+ */
+class Benchmark
+{
+public:
+    static void run(BMSModuleManager &bms);
+    static void crc();
+    static void decode();
+    static void thermistor();
+    static void aggregate(BMSModuleManager &bms);
+    static void snapshot();
+    static void logging();
+
+private:
+    static void report(const char *name, int iterations, uint32_t cycles);
+};
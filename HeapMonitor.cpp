@@ -0,0 +1,182 @@
+#include "HeapMonitor.h"
+#include "Logger.h"
+
+HeapSiteStats HeapMonitor::sites[HEAP_SITES];
+HeapSample HeapMonitor::history[HEAP_HISTORY_SAMPLES];
+int HeapMonitor::historyCount = 0;
+HeapSample HeapMonitor::interval = {0xFFFF, 0xFFFF, 0xFFFF};
+uint32_t HeapMonitor::lastSample = 0;
+uint32_t HeapMonitor::lastHistory = 0;
+multi_heap_info_t HeapMonitor::latest;
+uint32_t HeapMonitor::iterations = 0;
+uint32_t HeapMonitor::growing = 0;
+uint32_t HeapMonitor::growMax = 0;
+uint32_t HeapMonitor::lastFree = 0;
+uint32_t HeapMonitor::startFree = 0;
+uint32_t HeapMonitor::largestMin = 0xFFFFFFFF;
+size_t HeapMonitor::blocksMax = 0;
+int HeapMonitor::fragmentationMax = 0;
+uint32_t HeapMonitor::snapshots = 0;
+size_t HeapMonitor::startBlocks = 0;
+size_t HeapMonitor::lastBlocks = 0;
+int32_t HeapMonitor::blocksGrowMax = 0;
+
+static const char *names[HEAP_SITES] = {"scan", "pack stats", "label text"};
+
+//Share of the free heap that is not in the largest block, 0 = all in one piece
+static int fragmentation(const multi_heap_info_t &info)
+{
+    if (info.total_free_bytes == 0) return 0;
+    return 100 - (int)((uint64_t)info.largest_free_block * 100 / info.total_free_bytes);
+}
+
+static uint16_t toKb(size_t bytes)
+{
+    return (bytes / 1024 > 0xFFFF) ? 0xFFFF : bytes / 1024;
+}
+
+void HeapMonitor::loopIteration()
+{
+    uint32_t now = millis();
+    uint32_t free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+
+    if (iterations++ == 0)
+    {
+        startFree = free;
+        sample(now);
+    }
+    else if (free < lastFree)
+    {
+        growing++;
+        if (lastFree - free > growMax) growMax = lastFree - free;
+    }
+    lastFree = free;
+
+    if (now - lastSample >= HEAP_SAMPLE_MS) sample(now);
+    if (now - lastHistory >= BMS_HEAP_HISTORY_MIN * 60000UL)
+    {
+        interval.minEverKb = toKb(heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT));
+        history[historyCount++ % HEAP_HISTORY_SAMPLES] = interval;
+        //stays in step with the ring, wrapping it after years of uptime costs nothing
+        if (historyCount == 2 * HEAP_HISTORY_SAMPLES) historyCount = HEAP_HISTORY_SAMPLES;
+        interval.freeKb = interval.largestKb = 0xFFFF;
+        lastHistory = now;
+    }
+}
+
+void HeapMonitor::sample(uint32_t now)
+{
+    heap_caps_get_info(&latest, MALLOC_CAP_8BIT);
+    lastSample = now;
+
+    if (latest.largest_free_block < largestMin) largestMin = latest.largest_free_block;
+    if (latest.allocated_blocks > blocksMax) blocksMax = latest.allocated_blocks;
+    //blocks added since the previous snapshot, what the loop iterations in between allocated and kept
+    int32_t added = (int32_t)latest.allocated_blocks - (int32_t)lastBlocks;
+    if (snapshots++ == 0) startBlocks = latest.allocated_blocks;
+    else if (added > blocksGrowMax) blocksGrowMax = added;
+    lastBlocks = latest.allocated_blocks;
+    if (fragmentation(latest) > fragmentationMax) fragmentationMax = fragmentation(latest);
+    if (toKb(latest.total_free_bytes) < interval.freeKb) interval.freeKb = toKb(latest.total_free_bytes);
+    if (toKb(latest.largest_free_block) < interval.largestKb) interval.largestKb = toKb(latest.largest_free_block);
+}
+
+void HeapMonitor::add(int site, uint32_t freeBefore, uint32_t freeAfter)
+{
+    HeapSiteStats &s = sites[site];
+    int32_t bytes = (int32_t)freeBefore - (int32_t)freeAfter;
+
+    if (s.calls++ == 0 || bytes > s.bytesMax) s.bytesMax = bytes;
+    s.bytesSum += bytes;
+}
+
+bool HeapMonitor::sampleDue(int site)
+{
+    return BMS_HEAP_SCOPE_SAMPLE > 0 && sites[site].calls % BMS_HEAP_SCOPE_SAMPLE == 0;
+}
+
+void HeapMonitor::addSample(int site, const multi_heap_info_t &before, const multi_heap_info_t &after)
+{
+    HeapSiteStats &s = sites[site];
+    int32_t blocks = (int32_t)after.allocated_blocks - (int32_t)before.allocated_blocks;
+
+    if (s.sampled++ == 0 || blocks > s.blocksMax) s.blocksMax = blocks;
+    s.blocksSum += blocks;
+    if (after.largest_free_block < before.largest_free_block && before.largest_free_block - after.largest_free_block > s.largestDrop)
+    {
+        s.largestDrop = before.largest_free_block - after.largest_free_block;
+    }
+}
+
+/*
+ * The latest snapshot, what the loop iterations did since the last reset, the call sites (net bytes
+ * and, over the sampled calls, net blocks per call - a steady positive mean is a leak) and the
+ * history oldest first.
+ */
+void HeapMonitor::print()
+{
+    char line[160];
+    int count = (historyCount < HEAP_HISTORY_SAMPLES) ? historyCount : HEAP_HISTORY_SAMPLES;
+
+    Logger::console("");
+    Logger::console("Heap: %i free, %i min ever, %i largest block, %i%% fragmented, %i blocks allocated, %i free blocks",
+                    (int)latest.total_free_bytes, (int)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT), (int)latest.largest_free_block,
+                    fragmentation(latest), (int)latest.allocated_blocks, (int)latest.free_blocks);
+    if (iterations)
+    {
+        Logger::console("Since reset: %i loop iterations, %i ended with less free heap (worst %i bytes), free heap %i -> %i",
+                        (int)iterations, (int)growing, (int)growMax, (int)startFree, (int)lastFree);
+        Logger::console("             smallest largest block %i, most blocks allocated %i, worst fragmentation %i%%",
+                        (int)largestMin, (int)blocksMax, fragmentationMax);
+        Logger::console("             allocated blocks %i -> %i over %i snapshots, most added between two of them %i",
+                        (int)startBlocks, (int)lastBlocks, (int)snapshots, (int)blocksGrowMax);
+    }
+
+    Logger::console("Site          Calls     Bytes avg/max  Sampled  Blocks avg/max  Largest block drop");
+    for (int i = 0; i < HEAP_SITES; i++)
+    {
+        const HeapSiteStats &s = sites[i];
+        if (s.calls == 0)
+        {
+            snprintf(line, sizeof(line), "%-12s %6i", names[i], 0);
+            SERIALCONSOLE.println(line);
+            continue;
+        }
+        snprintf(line, sizeof(line), "%-12s %6lu  %8ld/%8ld  %7lu  %6ld/%6ld  %18lu", names[i], (unsigned long)s.calls,
+                 (long)(s.bytesSum / s.calls), (long)s.bytesMax, (unsigned long)s.sampled,
+                 (long)(s.sampled ? s.blocksSum / s.sampled : 0), (long)s.blocksMax, (unsigned long)s.largestDrop);
+        SERIALCONSOLE.println(line);
+    }
+
+    Logger::console("History, every %i min (KB free/largest/min ever):", BMS_HEAP_HISTORY_MIN);
+    for (int i = 0; i < count; i++)
+    {
+        const HeapSample &h = history[(historyCount - count + i) % HEAP_HISTORY_SAMPLES];
+        snprintf(line, sizeof(line), "%4i %5u/%5u/%5u", i, h.freeKb, h.largestKb, h.minEverKb);
+        SERIALCONSOLE.println(line);
+    }
+}
+
+//Statistics start over, the history stays
+void HeapMonitor::reset()
+{
+    memset(sites, 0, sizeof(sites));
+    iterations = 0;
+    growing = 0;
+    growMax = 0;
+    largestMin = 0xFFFFFFFF;
+    blocksMax = 0;
+    fragmentationMax = 0;
+    snapshots = 0;
+    blocksGrowMax = 0;
+}
+
+const HeapSiteStats &HeapMonitor::getStats(int site)
+{
+    return sites[site];
+}
+
+void HeapMonitor::setStats(int site, const HeapSiteStats &saved)
+{
+    sites[site] = saved;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include "bms_config.h"
+
+#define HEAP_HISTORY_SAMPLES  168   //one every BMS_HEAP_HISTORY_MIN minutes
+#define HEAP_SAMPLE_MS        1000  //full heap snapshot (walks the heap, too slow for every loop iteration)
+
+//The String building call sites. Keep names[] in HeapMonitor.cpp in the same order.
+enum HeapSite
+{
+    HEAP_SCAN,          //the bus part of BMSModuleManager::getAllVoltTemp, without the pack stats
+    HEAP_PACK_STATS,    //updatePackStats, bms_status and bms_modules_text
+    HEAP_LABEL,         //the label text concatenation in loop()
+    HEAP_SITES
+};
+
+struct HeapSiteStats
+{
+    uint32_t calls;
+    int64_t bytesSum;                     //free heap before minus after, net of what was freed again
+    int32_t bytesMax;
+    uint32_t sampled;                     //calls that also took a full heap snapshot at both ends
+    int64_t blocksSum;                    //allocated blocks after minus before, over the sampled calls
+    int32_t blocksMax;
+    uint32_t largestDrop;                 //worst shrink of the largest free block over a sampled call
+};
+
+//Kept in KB so two weeks of it fit in 1KB of RAM
+struct HeapSample
+{
+    uint16_t freeKb;                      //lowest free heap during the interval
+    uint16_t largestKb;                   //smallest largest free block during the interval
+    uint16_t minEverKb;                   //heap low water mark since boot
+};
+
+/*
+ * Heap health for a board that stays up for weeks while rebuilding its display texts out of String
+ * concatenations every second. Per loop iteration the change of free heap, every second a full
+ * snapshot (free, largest free block, fragmentation, allocated blocks and how many were added since
+ * the last one), and per String call site the net bytes it leaves allocated. Every
+ * BMS_HEAP_SCOPE_SAMPLE calls a site also takes a snapshot at both ends for its net blocks and the
+ * drop of the largest free block. A history of the low points runs independently of reset() so a
+ * slow leak or creeping fragmentation shows up over days. Console command A prints it all and starts
+ * the statistics over.
+ */
+class HeapMonitor
+{
+public:
+    static void loopIteration();          //call once at the end of loop()
+    static void add(int site, uint32_t freeBefore, uint32_t freeAfter);
+    static bool sampleDue(int site);      //the next call of the site should take the full snapshots
+    static void addSample(int site, const multi_heap_info_t &before, const multi_heap_info_t &after);
+    static void print();
+    static void reset();
+    static const HeapSiteStats &getStats(int site);
+    static void setStats(int site, const HeapSiteStats &saved); //put back what getStats() returned
+
+private:
+    static HeapSiteStats sites[HEAP_SITES];
+    static HeapSample history[HEAP_HISTORY_SAMPLES];
+    static int historyCount;              //samples taken so far, the ring holds the last HEAP_HISTORY_SAMPLES
+    static HeapSample interval;           //low points since the last history sample
+    static uint32_t lastSample;
+    static uint32_t lastHistory;
+    static multi_heap_info_t latest;
+    static uint32_t iterations;
+    static uint32_t growing;              //iterations that ended with less free heap than they began
+    static uint32_t growMax;              //most free heap one iteration used up
+    static uint32_t lastFree;
+    static uint32_t startFree;
+    static uint32_t largestMin;
+    static size_t blocksMax;
+    static int fragmentationMax;
+    static uint32_t snapshots;            //full snapshots since reset
+    static size_t startBlocks;            //allocated blocks at the first of them
+    static size_t lastBlocks;
+    static int32_t blocksGrowMax;         //most blocks added from one snapshot to the next
+
+    static void sample(uint32_t now);
+};
+
+//Every call reads the free size counter the allocator keeps, the heap walk only runs on sampled calls
+class HeapScope
+{
+public:
+    explicit HeapScope(int site) : site(site), sampled(HeapMonitor::sampleDue(site))
+    {
+        if (sampled) heap_caps_get_info(&before, MALLOC_CAP_8BIT);
+        freeBefore = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    }
+    ~HeapScope()
+    {
+        uint32_t freeAfter = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+        if (sampled)
+        {
+            multi_heap_info_t after;
+            heap_caps_get_info(&after, MALLOC_CAP_8BIT);
+            HeapMonitor::addSample(site, before, after);
+        }
+        HeapMonitor::add(site, freeBefore, freeAfter);
+    }
+
+private:
+    int site;
+    bool sampled;
+    uint32_t freeBefore;
+    multi_heap_info_t before;
+};
+
+//Measures what the rest of the enclosing block leaves on the heap
+#if BMS_HEAP_MONITOR
+#define BMS_HEAP_SCOPE(site) HeapScope heapScope(site)
+#else
+#define BMS_HEAP_SCOPE(site)
+#endif
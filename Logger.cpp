@@ -28,6 +28,7 @@
 
 Logger::LogLevel Logger::logLevel = Logger::Info;
 uint32_t Logger::lastLogTime = 0;
+Print *Logger::output = &SERIALCONSOLE;
 
 /*
  * Output a debug message with a variable amount of parameters.
@@ -100,6 +101,14 @@ void Logger::setLoglevel(LogLevel level) {
     logLevel = level;
 }
 
+/*
+ * Send all log and console output somewhere else than SERIALCONSOLE, e.g. a sink that discards
+ * it to time the formatting on its own. NULL goes back to SERIALCONSOLE.
+ */
+void Logger::setOutput(Print *stream) {
+    output = stream ? stream : &SERIALCONSOLE;
+}
+
 /*
  * Retrieve the current log level.
  */
@@ -148,24 +157,24 @@ boolean Logger::isDebug() {
  */
 void Logger::log(LogLevel level, char *format, va_list args) {
     lastLogTime = millis();
-    SERIALCONSOLE.print(lastLogTime);
-    SERIALCONSOLE.print(" - ");
+    output->print(lastLogTime);
+    output->print(" - ");
 
     switch (level) {
     case Debug:
-        SERIALCONSOLE.print("DEBUG");
+        output->print("DEBUG");
         break;
     case Info:
-        SERIALCONSOLE.print("INFO");
+        output->print("INFO");
         break;
     case Warn:
-        SERIALCONSOLE.print("WARNING");
+        output->print("WARNING");
         break;
     case Error:
-        SERIALCONSOLE.print("ERROR");
+        output->print("ERROR");
         break;
     }
-    SERIALCONSOLE.print(": ");
+    output->print(": ");
 
     logMessage(format, args);
 }
@@ -195,69 +204,69 @@ void Logger::logMessage(char *format, va_list args) {
             if (*format == '\0')
                 break;
             if (*format == '%') {
-                SERIALCONSOLE.print(*format);
+                output->print(*format);
                 continue;
             }
             if (*format == 's') {
-                register char *s = (char *) va_arg( args, int );
-                SERIALCONSOLE.print(s);
+                register char *s = va_arg( args, char * );
+                output->print(s);
                 continue;
             }
             if (*format == 'd' || *format == 'i') {
-                SERIALCONSOLE.print(va_arg( args, int ), DEC);
+                output->print(va_arg( args, int ), DEC);
                 continue;
             }
             if (*format == 'f') {
-                SERIALCONSOLE.print(va_arg( args, double ), 3);
+                output->print(va_arg( args, double ), 3);
                 continue;
             }
             if (*format == 'x') {
-                SERIALCONSOLE.print(va_arg( args, int ), HEX);
+                output->print(va_arg( args, int ), HEX);
                 continue;
             }
             if (*format == 'X') {
-                SERIALCONSOLE.print("0x");
-                SERIALCONSOLE.print(va_arg( args, int ), HEX);
+                output->print("0x");
+                output->print(va_arg( args, int ), HEX);
                 continue;
             }
             if (*format == 'b') {
-                SERIALCONSOLE.print(va_arg( args, int ), BIN);
+                output->print(va_arg( args, int ), BIN);
                 continue;
             }
             if (*format == 'B') {
-                SERIALCONSOLE.print("0b");
-                SERIALCONSOLE.print(va_arg( args, int ), BIN);
+                output->print("0b");
+                output->print(va_arg( args, int ), BIN);
                 continue;
             }
             if (*format == 'l') {
-                SERIALCONSOLE.print(va_arg( args, long ), DEC);
+                output->print(va_arg( args, long ), DEC);
                 continue;
             }
 
             if (*format == 'c') {
-                SERIALCONSOLE.print(va_arg( args, int ));
+                output->print(va_arg( args, int ));
                 continue;
             }
             if (*format == 't') {
                 if (va_arg( args, int ) == 1) {
-                    SERIALCONSOLE.print("T");
+                    output->print("T");
                 } else {
-                    SERIALCONSOLE.print("F");
+                    output->print("F");
                 }
                 continue;
             }
             if (*format == 'T') {
                 if (va_arg( args, int ) == 1) {
-                    SERIALCONSOLE.print("TRUE");
+                    output->print("TRUE");
                 } else {
-                    SERIALCONSOLE.print("FALSE");
+                    output->print("FALSE");
                 }
                 continue;
             }
 
         }
-        SERIALCONSOLE.print(*format);
+        output->print(*format);
     }
-    SERIALCONSOLE.println();
+    output->println();
 }
 
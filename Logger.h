@@ -41,12 +41,14 @@ public:
     static void error(char *, ...);
     static void console(char *, ...);
     static void setLoglevel(LogLevel);
+    static void setOutput(Print *stream);
     static LogLevel getLogLevel();
     static uint32_t getLastLogTime();
     static boolean isDebug();
 private:
     static LogLevel logLevel;
     static uint32_t lastLogTime;
+    static Print *output;
 
     static void log(LogLevel, char *format, va_list);
     static void logMessage(char *format, va_list args);
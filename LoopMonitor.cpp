@@ -0,0 +1,106 @@
+#include "LoopMonitor.h"
+#include "Logger.h"
+
+LoopJobStats LoopMonitor::jobs[JOB_COUNT];
+
+static const char *names[JOB_COUNT] = {"bms poll", "balance", "battery volt", "page switch", "label"};
+
+void LoopMonitor::setJob(int job, uint32_t periodMs, uint32_t budgetMs)
+{
+    jobs[job].period = periodMs * 1000;
+    jobs[job].budget = budgetMs * 1000;
+}
+
+void LoopMonitor::start(int job)
+{
+    LoopJobStats &s = jobs[job];
+    uint32_t now = micros();
+
+    s.startedAt = now;
+    if (s.runs++ == 0 || s.period == 0)
+    {
+        s.lastStart = now;
+        return;
+    }
+
+    uint32_t period = now - s.lastStart;
+    uint32_t late = (period > s.period) ? period - s.period : 0;
+    uint32_t lateMs = late / 1000;
+    int bucket = lateMs ? 32 - __builtin_clz(lateMs) : 0;
+    s.lastStart = now;
+
+    if (s.runs == 2 || period < s.periodMin) s.periodMin = period;
+    if (period > s.periodMax) s.periodMax = period;
+    s.periodSum += period;
+    if (late > s.lateMax) s.lateMax = late;
+    s.lateSum += late;
+    s.histogram[bucket < LOOP_MONITOR_BUCKETS ? bucket : LOOP_MONITOR_BUCKETS - 1]++;
+
+    if (late > s.budget)
+    {
+        s.overruns++;
+        //every overrun would flood the console right when the loop is struggling
+        if ((s.overruns & (s.overruns - 1)) == 0) Logger::warn("Loop job %s started %l ms late (overrun #%l)", names[job], (long)(late / 1000), (long)s.overruns);
+    }
+}
+
+void LoopMonitor::end(int job)
+{
+    LoopJobStats &s = jobs[job];
+    uint32_t took = micros() - s.startedAt;
+
+    if (took > s.runMax) s.runMax = took;
+    s.runSum += took;
+}
+
+/*
+ * Times in ms except the run time. The histogram lists the lateness buckets that saw anything as
+ * <upper bound ms>:<count>.
+ */
+void LoopMonitor::print()
+{
+    char line[200];
+    int pos;
+
+    Logger::console("");
+    Logger::console("Job           Runs  Period ms min/avg/max   Late ms avg/max  Run us avg/max  Overruns  Lateness (<ms:count)");
+    for (int i = 0; i < JOB_COUNT; i++)
+    {
+        const LoopJobStats &s = jobs[i];
+        uint32_t periods = (s.runs > 1 && s.period) ? s.runs - 1 : 0;
+        pos = snprintf(line, sizeof(line), "%-12s %6lu", names[i], (unsigned long)s.runs);
+        if (periods)
+        {
+            pos += snprintf(line + pos, sizeof(line) - pos, "  %6lu/%6lu/%6lu   %6lu/%6lu", (unsigned long)(s.periodMin / 1000),
+                            (unsigned long)(s.periodSum / periods / 1000), (unsigned long)(s.periodMax / 1000),
+                            (unsigned long)(s.lateSum / periods / 1000), (unsigned long)(s.lateMax / 1000));
+        }
+        else pos += snprintf(line + pos, sizeof(line) - pos, "  %20s   %13s", "-", "-");
+        pos += snprintf(line + pos, sizeof(line) - pos, "  %6lu/%7lu  %8lu ", (unsigned long)(s.runs ? s.runSum / s.runs : 0),
+                        (unsigned long)s.runMax, (unsigned long)s.overruns);
+        for (int b = 0; b < LOOP_MONITOR_BUCKETS && pos < (int)sizeof(line) - 1; b++)
+        {
+            if (s.histogram[b] == 0) continue;
+            pos += snprintf(line + pos, sizeof(line) - pos, " <%lu:%lu", 1UL << b, (unsigned long)s.histogram[b]);
+        }
+        SERIALCONSOLE.println(line);
+    }
+}
+
+//Statistics start over, the configured periods and budgets stay
+void LoopMonitor::reset()
+{
+    for (int i = 0; i < JOB_COUNT; i++)
+    {
+        uint32_t period = jobs[i].period;
+        uint32_t budget = jobs[i].budget;
+        memset(&jobs[i], 0, sizeof(jobs[i]));
+        jobs[i].period = period;
+        jobs[i].budget = budget;
+    }
+}
+
+const LoopJobStats &LoopMonitor::getStats(int job)
+{
+    return jobs[job];
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <Arduino.h>
+#include "bms_config.h"
+
+#define LOOP_MONITOR_BUCKETS  16  //lateness under 1ms, 1ms, 2-3ms, 4-7ms ... the last one takes anything from ~16s
+
+//The periodic jobs of loop(). Keep names[] in LoopMonitor.cpp in the same order.
+enum LoopJob
+{
+    JOB_BMS_POLL,       //pack scan, BMS_POLL_INTERVAL_MS
+    JOB_BALANCE,        //balancing run, only when the pack needs it so it has no period
+    JOB_BATTERY_VOLT,   //board battery voltage to the UI
+    JOB_PAGE_SWITCH,    //UI page rotation
+    JOB_LABEL,          //BMS label text
+    JOB_COUNT
+};
+
+struct LoopJobStats
+{
+    uint32_t period;                      //us the job is due after the previous run, 0 = not periodic
+    uint32_t budget;                      //us it may start late before that counts as an overrun
+    uint32_t runs;
+    uint32_t lastStart;                   //micros() of the last run
+    uint32_t startedAt;                   //micros() of the run in progress
+    uint32_t periodMin;                   //us between runs as measured
+    uint32_t periodMax;
+    uint64_t periodSum;
+    uint32_t lateMax;                     //us past the due time
+    uint64_t lateSum;
+    uint32_t runMax;                      //us the job itself took
+    uint64_t runSum;
+    uint32_t overruns;
+    uint32_t histogram[LOOP_MONITOR_BUCKETS]; //lateness, bucket n > 0 holds 2^(n-1) .. 2^n - 1 ms
+};
+
+/*
+ * Keeps an eye on the millis() timers in loop(): how far apart the runs of each job actually are,
+ * how late they start against their period, how long they take, and how often one started more than
+ * its budget late (overrun, logged as a warning the 1st, 2nd, 4th, 8th ... time). Console command J
+ * prints it all with a lateness histogram per job and starts over.
+ */
+class LoopMonitor
+{
+public:
+    static void setJob(int job, uint32_t periodMs, uint32_t budgetMs);
+    static void start(int job);           //call as the job begins
+    static void end(int job);             //and when it is done
+    static void print();
+    static void reset();
+    static const LoopJobStats &getStats(int job);
+
+private:
+    static LoopJobStats jobs[JOB_COUNT];
+};
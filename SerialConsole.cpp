@@ -26,6 +26,11 @@
 #include "SerialConsole.h"
 #include "Logger.h"
 #include "BMSModuleManager.h"
+#include "Benchmark.h"
+#include "BMSTrace.h"
+#include "BMSProfiler.h"
+#include "LoopMonitor.h"
+#include "HeapMonitor.h"
 
 template<class T> inline Print &operator <<(Print &obj, T arg) {
   obj.print(arg);  //Lets us stream SerialUSB
@@ -79,6 +84,13 @@ void SerialConsole::printMenu() {
   Logger::console("   B = Attempt balancing for 5 seconds");
   Logger::console("   p = Toggle output of pack summary every 3 seconds");
   Logger::console("   d = Toggle output of pack details every 3 seconds");
+  Logger::console("   L = Print link statistics for each module");
+  Logger::console("   T = Dump the bus trace (decode with host/bmstrace)");
+  Logger::console("   M = Run microbenchmarks");
+  Logger::console("   P = Print and reset the loop stage profiler");
+  Logger::console("   J = Print and reset the loop job timing (period, lateness, overruns)");
+  Logger::console("   A = Print and reset the heap statistics (fragmentation, String allocations, history)");
+  Logger::console("   X = Toggle capture of every scan (replay with host/bmsreplay)");
 
   Logger::console("   LOGLEVEL=%i - set log level (0=debug, 1=info, 2=warn, 3=error, 4=off)", Logger::getLogLevel());
 
@@ -155,6 +167,32 @@ void SerialConsole::handleShortCmd()
     case 'B':
       bms.balanceCells();
       break;
+    case 'L':
+      bms.printLinkStats();
+      break;
+    case 'T':
+      BMSTrace::dump();
+      break;
+    case 'M':
+      Benchmark::run(bms);
+      break;
+    case 'P':
+      BMSProfiler::print();
+      BMSProfiler::reset();
+      break;
+    case 'J':
+      LoopMonitor::print();
+      LoopMonitor::reset();
+      break;
+    case 'A':
+      HeapMonitor::print();
+      HeapMonitor::reset();
+      break;
+    case 'X':
+      bms.setCapture(!bms.isCapturing());
+      if (bms.isCapturing()) Logger::console("Capturing every scan");
+      else Logger::console("Capture stopped");
+      break;
     case 'p':
       if (whichDisplay == 1 && printPrettyDisplay) whichDisplay = 0;
       else
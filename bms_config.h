@@ -6,6 +6,17 @@
 #define BMS_NUM_PARALLEL              1 // Number of modules in parallel
 #define BMS_BALANCE_VOLTAGE_MIN       4.0 // Volts
 #define BMS_BALANCE_VOLTAGE_DELTA     0.04 // Volts
+#define BMS_BROADCAST_ADC             1 // 1 = start the ADC on all modules with one broadcast (time coherent pack snapshot), 0 = one module at a time
+#define BMS_TEMP_POLL_CYCLES          4 // Read temperatures every Nth scan (cell voltages are read every scan)
+#define BMS_STATUS_POLL_CYCLES        10 // Read alert/fault status every Nth scan, or right away when the fault line is asserted
+#define BMS_DISCOVERY_MAX_GAP         3 // Stop looking for more modules after this many empty addresses in a row
+#define BMS_POLL_INTERVAL_MS          500 // Pack scan period
+#define BMS_POLL_LATE_BUDGET_MS       50 // A scan starting more than this late counts as an overrun (console command J)
+#define BMS_BENCHMARK                 1 // 1 = build the microbenchmarks of console command M, 0 leaves them out of the firmware
+#define BMS_PROFILER                  1 // 1 = time the scan, balancing and UI stages with the CPU cycle counter (console command P)
+#define BMS_HEAP_MONITOR              1 // 1 = track heap use and fragmentation of the String handling (console command A)
+#define BMS_HEAP_SCOPE_SAMPLE         16 // Every Nth call of a String call site also counts heap blocks and the largest free block (walks the heap), 0 = never
+#define BMS_HEAP_HISTORY_MIN          120 // Minutes between the heap history samples, 168 of them cover two weeks
 
 #include <Arduino.h>
 
@@ -0,0 +1,159 @@
+#include "FaultInjector.h"
+
+#define FAULT_MAX_FRAME 512
+
+FaultInjector::FaultInjector(SerialPeer &downstream) : downstream(downstream)
+{
+    memset(&mix, 0, sizeof(mix));
+    seed = 1;
+    resetCounters();
+}
+
+void FaultInjector::attach(HardwareSerial &port)
+{
+    port.attach(this);
+    port.setRxFilter(this);
+}
+
+void FaultInjector::setMix(const FaultMix &mix)
+{
+    this->mix = mix;
+}
+
+void FaultInjector::setSeed(uint32_t seed)
+{
+    this->seed = seed;
+}
+
+void FaultInjector::resetCounters()
+{
+    dropped = 0;
+    corrupted = 0;
+    duplicated = 0;
+    delayed = 0;
+    truncated = 0;
+}
+
+uint32_t FaultInjector::getDropped()
+{
+    return dropped;
+}
+
+uint32_t FaultInjector::getCorrupted()
+{
+    return corrupted;
+}
+
+uint32_t FaultInjector::getDuplicated()
+{
+    return duplicated;
+}
+
+uint32_t FaultInjector::getDelayed()
+{
+    return delayed;
+}
+
+uint32_t FaultInjector::getTruncated()
+{
+    return truncated;
+}
+
+uint32_t FaultInjector::nextRandom()
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+bool FaultInjector::chance(float rate)
+{
+    if (rate <= 0.0f) return false;
+    return (nextRandom() & 0xFFFFF) < rate * 1048576.0f;
+}
+
+/*
+ * Request on its way to the boards. There is no timing to mess with on this side, the simulator
+ * clocks the bytes out itself.
+ */
+void FaultInjector::receive(HardwareSerial &port, const uint8_t *data, size_t len)
+{
+    uint8_t out[FAULT_MAX_FRAME];
+    size_t count = 0;
+
+    if (!mix.requests || len > FAULT_MAX_FRAME / 2)
+    {
+        downstream.receive(port, data, len);
+        return;
+    }
+    for (size_t i = 0; i < len; i++)
+    {
+        if (chance(mix.truncate))
+        {
+            truncated++;
+            break;
+        }
+        if (chance(mix.drop))
+        {
+            dropped++;
+            continue;
+        }
+        out[count] = data[i];
+        if (chance(mix.corrupt))
+        {
+            out[count] ^= 1 << (nextRandom() % 8);
+            corrupted++;
+        }
+        count++;
+        if (chance(mix.duplicate))
+        {
+            out[count] = out[count - 1];
+            count++;
+            duplicated++;
+        }
+    }
+    if (count > 0) downstream.receive(port, out, count);
+}
+
+/*
+ * Reply on its way back. Bytes are handed to the port one by one so a delay can open a gap in the
+ * middle of a frame, everything behind it arrives that much later.
+ */
+void FaultInjector::filter(HardwareSerial &port, const uint8_t *data, size_t len, uint64_t firstByteAt)
+{
+    uint64_t at = firstByteAt;
+    uint8_t c;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (chance(mix.truncate))
+        {
+            truncated++;
+            return;
+        }
+        if (chance(mix.delay))
+        {
+            at += mix.delayUs;
+            delayed++;
+        }
+        if (chance(mix.drop))
+        {
+            dropped++;
+            at += port.getByteTime(); //the slot stays empty on the wire
+            continue;
+        }
+        c = data[i];
+        if (chance(mix.corrupt))
+        {
+            c ^= 1 << (nextRandom() % 8);
+            corrupted++;
+        }
+        port.deliver(&c, 1, at);
+        at += port.getByteTime();
+        if (chance(mix.duplicate))
+        {
+            port.deliver(&c, 1, at);
+            at += port.getByteTime();
+            duplicated++;
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <Arduino.h>
+
+/*
+ * Fault rates for FaultInjector. The byte rates apply to every byte, truncate to every frame.
+ */
+struct FaultMix
+{
+    float drop;         //byte vanishes
+    float corrupt;      //one bit of the byte flips
+    float duplicate;    //byte arrives twice
+    float delay;        //a gap of delayUs opens up before the byte
+    float truncate;     //the rest of the frame is lost from a random byte on
+    uint32_t delayUs;
+    bool requests;      //damage requests on their way to the boards too, not only the replies
+};
+
+/*
+ * Glitchy wire between a host serial port and whatever is attached to it (normally the module chain
+ * simulator). Requests pass through receive() on the way out, replies through filter() on the way
+ * back, and both get damaged at the rates of the current FaultMix. Every decision comes from a
+ * seeded LCG so a run can be repeated exactly.
+ */
+class FaultInjector : public SerialPeer, public SerialFilter
+{
+public:
+    FaultInjector(SerialPeer &downstream);
+
+    void attach(HardwareSerial &port);
+    void setMix(const FaultMix &mix);
+    void setSeed(uint32_t seed);
+    void resetCounters();
+
+    uint32_t getDropped();
+    uint32_t getCorrupted();
+    uint32_t getDuplicated();
+    uint32_t getDelayed();
+    uint32_t getTruncated();
+
+    void receive(HardwareSerial &port, const uint8_t *data, size_t len);
+    void filter(HardwareSerial &port, const uint8_t *data, size_t len, uint64_t firstByteAt);
+
+private:
+    SerialPeer &downstream;
+    FaultMix mix;
+    uint32_t seed;
+    uint32_t dropped;
+    uint32_t corrupted;
+    uint32_t duplicated;
+    uint32_t delayed;
+    uint32_t truncated;
+
+    bool chance(float rate);
+    uint32_t nextRandom();
+};
@@ -0,0 +1,377 @@
+#include "ModuleChainSim.h"
+#include "bms_config.h"
+#include "BMSCrc.h"
+#include "HostClock.h"
+
+#define SIM_REG_DEVICE_STATUS 0x00
+#define SIM_REG_RESET         0x3C
+#define SIM_RESET_KEY         0xA5
+#define SIM_BROADCAST         0x3F
+
+#define ALERT_SLEEP           0x04
+#define ALERT_NO_ADDRESS      0x80
+#define FAULT_CRC             0x04
+#define FAULT_POR             0x08
+
+//Protected setpoint registers 0x40-0x47 as a Tesla board reports them after a reset
+static const uint8_t defaultSetpoints[8] = {0x10, 0x80, 0x31, 0x81, 0x08, 0x81, 0x66, 0xFF};
+
+ModuleChainSim::ModuleChainSim(int modules)
+{
+    if (modules < 0) modules = 0;
+    if (modules > SIM_MAX_MODULES) modules = SIM_MAX_MODULES;
+    boards.resize(modules);
+    for (int i = 0; i < modules; i++)
+    {
+        for (int c = 0; c < 6; c++) boards[i].cellVolt[c] = 3.7f;
+        boards[i].temperature[0] = 25.0f;
+        boards[i].temperature[1] = 25.0f;
+    }
+    hopDelay = SIM_HOP_DELAY_US;
+    turnaround = SIM_TURNAROUND_US;
+    conversionTime = SIM_CONVERSION_US;
+    noise = 0;
+    errorRate = 0.0f;
+    seed = 1;
+    frameCount = 0;
+    crcErrors = 0;
+    corrupted = 0;
+    requestBytes = 0;
+    replyBytes = 0;
+    powerOn();
+}
+
+void ModuleChainSim::attach(HardwareSerial &port)
+{
+    port.attach(this);
+}
+
+void ModuleChainSim::powerOn()
+{
+    for (size_t i = 0; i < boards.size(); i++) resetBoard(boards[i]);
+    requestLen = 0;
+    lastByteAt = 0;
+    wireFreeAt = 0;
+}
+
+void ModuleChainSim::resetBoard(Board &board)
+{
+    memset(board.regs, 0, sizeof(board.regs));
+    memcpy(&board.regs[0x40], defaultSetpoints, sizeof(defaultSetpoints));
+    board.regs[REG_FAULT_STATUS] = FAULT_POR;
+    board.converting = false;
+    updateAlerts(board);
+}
+
+int ModuleChainSim::getModuleCount()
+{
+    return boards.size();
+}
+
+void ModuleChainSim::setCellVoltage(int position, int cell, float volts)
+{
+    if (position < 0 || position >= (int)boards.size() || cell < 0 || cell > 5) return;
+    boards[position].cellVolt[cell] = volts;
+}
+
+void ModuleChainSim::setTemperature(int position, int sensor, float celsius)
+{
+    if (position < 0 || position >= (int)boards.size() || sensor < 0 || sensor > 1) return;
+    boards[position].temperature[sensor] = celsius;
+}
+
+float ModuleChainSim::getCellVoltage(int position, int cell)
+{
+    if (position < 0 || position >= (int)boards.size() || cell < 0 || cell > 5) return 0.0f;
+    return boards[position].cellVolt[cell];
+}
+
+float ModuleChainSim::getTemperature(int position, int sensor)
+{
+    if (position < 0 || position >= (int)boards.size() || sensor < 0 || sensor > 1) return 0.0f;
+    return boards[position].temperature[sensor];
+}
+
+uint8_t ModuleChainSim::getAddress(int position)
+{
+    if (position < 0 || position >= (int)boards.size()) return 0;
+    return boards[position].regs[REG_ADDR_CTRL] & 0x3F;
+}
+
+uint8_t ModuleChainSim::getRegister(int position, uint8_t reg)
+{
+    if (position < 0 || position >= (int)boards.size() || reg >= SIM_REGISTERS) return 0;
+    finishConversion(boards[position], HostClock::now());
+    return boards[position].regs[reg];
+}
+
+void ModuleChainSim::setRegister(int position, uint8_t reg, uint8_t value)
+{
+    if (position < 0 || position >= (int)boards.size() || reg >= SIM_REGISTERS) return;
+    boards[position].regs[reg] = value;
+}
+
+void ModuleChainSim::setNoise(int lsb)
+{
+    noise = (lsb < 0) ? 0 : lsb;
+}
+
+void ModuleChainSim::setTiming(uint32_t hopDelay, uint32_t turnaround, uint32_t conversion)
+{
+    this->hopDelay = hopDelay;
+    this->turnaround = turnaround;
+    conversionTime = conversion;
+}
+
+void ModuleChainSim::setErrorRate(float rate)
+{
+    errorRate = rate;
+}
+
+uint32_t ModuleChainSim::getFrameCount()
+{
+    return frameCount;
+}
+
+uint32_t ModuleChainSim::getCrcErrorCount()
+{
+    return crcErrors;
+}
+
+uint32_t ModuleChainSim::getCorruptedCount()
+{
+    return corrupted;
+}
+
+uint64_t ModuleChainSim::getRequestBytes()
+{
+    return requestBytes;
+}
+
+uint64_t ModuleChainSim::getReplyBytes()
+{
+    return replyBytes;
+}
+
+/*
+ * Bytes written by the firmware. They go out back to back from whenever the line is free; a frame
+ * is complete after 3 bytes for a read and 4 (with CRC) for a write.
+ */
+void ModuleChainSim::receive(HardwareSerial &port, const uint8_t *data, size_t len)
+{
+    uint64_t at = HostClock::now();
+    if (wireFreeAt > at) at = wireFreeAt;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        at += port.getByteTime();
+        if (requestLen > 0 && at - lastByteAt > SIM_FRAME_GAP_US) requestLen = 0;
+        lastByteAt = at;
+        request[requestLen++] = data[i];
+        if (requestLen == ((request[0] & 1) ? 4 : 3))
+        {
+            handleFrame(port, at);
+            requestLen = 0;
+        }
+    }
+    wireFreeAt = at;
+    requestBytes += len;
+}
+
+void ModuleChainSim::handleFrame(HardwareSerial &port, uint64_t endAt)
+{
+    uint8_t frame[SIM_REGISTERS + 4];
+    bool isWrite = request[0] & 1;
+    uint8_t address = request[0] >> 1;
+    uint8_t reg = request[1];
+    uint8_t value = request[2];
+    int position = -1;
+
+    frameCount++;
+
+    if (address == SIM_BROADCAST)
+    {
+        if (!isWrite) return;
+        if (BMSCRC8::compute(request, 3) != request[3])
+        {
+            crcErrors++;
+            for (size_t i = 0; i < boards.size(); i++) boards[i].regs[REG_FAULT_STATUS] |= FAULT_CRC;
+            return;
+        }
+        for (size_t i = 0; i < boards.size(); i++) writeRegister(boards[i], reg, value, endAt);
+        if (boards.empty()) return;
+        memcpy(frame, request, 4);
+        reply(port, frame, 4, boards.size(), endAt);
+        return;
+    }
+
+    //the request travels down the chain until a board with that address takes it
+    for (size_t i = 0; i < boards.size(); i++)
+    {
+        if ((boards[i].regs[REG_ADDR_CTRL] & 0x3F) == address)
+        {
+            position = i;
+            break;
+        }
+    }
+    if (position < 0) return;
+
+    Board &board = boards[position];
+    //boards without an address answer with the top bit set
+    frame[0] = request[0] | ((board.regs[REG_ADDR_CTRL] & 0x3F) == 0 ? 0x80 : 0);
+    frame[1] = reg;
+    frame[2] = value;
+
+    if (isWrite)
+    {
+        if (BMSCRC8::compute(request, 3) != request[3])
+        {
+            crcErrors++;
+            board.regs[REG_FAULT_STATUS] |= FAULT_CRC;
+            return;
+        }
+        writeRegister(board, reg, value, endAt);
+        frame[3] = BMSCRC8::compute(frame, 3);
+        reply(port, frame, 4, position + 1, endAt);
+        return;
+    }
+
+    if (value > SIM_REGISTERS) return; //more than a board would ever send, treat as garbage
+    finishConversion(board, endAt);
+    for (int i = 0; i < value; i++) frame[3 + i] = (reg + i < SIM_REGISTERS) ? board.regs[reg + i] : 0;
+    frame[3 + value] = BMSCRC8::compute(frame, 3 + value);
+    reply(port, frame, value + 4, position + 1, endAt);
+}
+
+void ModuleChainSim::writeRegister(Board &board, uint8_t reg, uint8_t value, uint64_t now)
+{
+    switch (reg)
+    {
+    case REG_ALERT_STATUS:
+    case REG_FAULT_STATUS:
+        //latched bits are cleared by writing a one, they come straight back if the cause is still there
+        board.regs[reg] &= ~value;
+        updateAlerts(board);
+        break;
+    case REG_COV_FAULT:
+    case REG_CUV_FAULT:
+    case SIM_REG_DEVICE_STATUS:
+        break; //read only
+    case REG_IO_CTRL:
+        board.regs[reg] = value;
+        updateAlerts(board);
+        break;
+    case REG_ADC_CONV:
+        if (value & 1) startConversion(board, now);
+        break;
+    case REG_ADDR_CTRL:
+        if (value & 0x80)
+        {
+            board.regs[REG_ADDR_CTRL] = value;
+            board.regs[SIM_REG_DEVICE_STATUS] |= 0x80; //address assigned
+            updateAlerts(board);
+        }
+        break;
+    case SIM_REG_RESET:
+        if (value == SIM_RESET_KEY) resetBoard(board);
+        break;
+    default:
+        if (reg < SIM_REGISTERS) board.regs[reg] = value;
+        break;
+    }
+}
+
+void ModuleChainSim::updateAlerts(Board &board)
+{
+    if (board.regs[REG_IO_CTRL] & 0x04) board.regs[REG_ALERT_STATUS] |= ALERT_SLEEP;
+    if ((board.regs[REG_ADDR_CTRL] & 0x3F) == 0) board.regs[REG_ALERT_STATUS] |= ALERT_NO_ADDRESS;
+    else board.regs[REG_ALERT_STATUS] &= ~ALERT_NO_ADDRESS;
+}
+
+uint16_t ModuleChainSim::adcCode(float value)
+{
+    int code = (int)(value + 0.5f);
+    if (noise > 0) code += (int)(nextRandom() % (2 * noise + 1)) - noise;
+    if (code < 0) code = 0;
+    if (code > 0x3FFF) code = 0x3FFF; //14 bit ADC
+    return code;
+}
+
+//Thermistor resistance for a temperature, inverting the Steinhart-Hart fit BMSModule uses
+static float thermistorKOhm(float celsius)
+{
+    const double a = 0.0007610373573, b = 0.0002728524832, c = 0.0000001022822735;
+    double target = 1.0 / (celsius + 273.15);
+    double lnR = 9.21; //10k
+    for (int i = 0; i < 20; i++) lnR -= (a + b * lnR + c * lnR * lnR * lnR - target) / (b + 3 * c * lnR * lnR);
+    return exp(lnR) / 1000.0;
+}
+
+/*
+ * Sample the inputs selected in ADC_CTRL (cells 1..n, GPAI and the temperature inputs if IO_CTRL
+ * powers them). The results only show up in the registers once the conversion time has passed.
+ */
+void ModuleChainSim::startConversion(Board &board, uint64_t now)
+{
+    uint8_t adcControl = board.regs[REG_ADC_CTRL];
+    int cells = (adcControl & 0x07) + 1;
+    int channels = cells;
+    float total = 0.0f;
+    uint16_t code;
+
+    finishConversion(board, now);
+    memcpy(board.result, &board.regs[REG_GPAI], sizeof(board.result));
+    for (int c = 0; c < 6; c++) total += board.cellVolt[c];
+    for (int c = 0; c < cells; c++)
+    {
+        code = adcCode(board.cellVolt[c] / 0.000381493f);
+        board.result[REG_VCELL1 - REG_GPAI + c * 2] = code >> 8;
+        board.result[REG_VCELL1 - REG_GPAI + c * 2 + 1] = code & 0xFF;
+    }
+    if (adcControl & 0x08)
+    {
+        code = adcCode(total / 0.002034609f);
+        board.result[0] = code >> 8;
+        board.result[1] = code & 0xFF;
+        channels++;
+    }
+    for (int t = 0; t < 2; t++)
+    {
+        if (!(adcControl & (0x10 << t)) || !(board.regs[REG_IO_CTRL] & (1 << t))) continue;
+        //the two inputs have slightly different offsets, see BMSModule::readADCValues
+        float kOhm = thermistorKOhm(board.temperature[t]);
+        code = adcCode(t == 0 ? 1.78f * 33046.0f / (kOhm + 3.57f) - 2 : 1.78f * 33068.0f / (kOhm + 3.57f) - 9);
+        board.result[REG_TEMPERATURE1 - REG_GPAI + t * 2] = code >> 8;
+        board.result[REG_TEMPERATURE1 - REG_GPAI + t * 2 + 1] = code & 0xFF;
+        channels++;
+    }
+    board.conversionDone = now + (uint64_t)channels * conversionTime;
+    board.converting = true;
+}
+
+void ModuleChainSim::finishConversion(Board &board, uint64_t now)
+{
+    if (!board.converting || now < board.conversionDone) return;
+    memcpy(&board.regs[REG_GPAI], board.result, sizeof(board.result));
+    board.converting = false;
+}
+
+//Small LCG so runs with noise or errors are repeatable
+uint32_t ModuleChainSim::nextRandom()
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+void ModuleChainSim::reply(HardwareSerial &port, uint8_t *frame, int len, int hops, uint64_t endAt)
+{
+    uint64_t start = endAt + turnaround + 2ULL * hops * hopDelay;
+
+    if (errorRate > 0.0f && (nextRandom() & 0xFFFF) < errorRate * 65536.0f)
+    {
+        frame[nextRandom() % len] ^= 1 << (nextRandom() % 8);
+        corrupted++;
+    }
+    replyBytes += len;
+    port.inject(frame, len, start + port.getByteTime());
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <Arduino.h>
+#include <vector>
+
+#define SIM_MAX_MODULES        62   //addresses 1 - 0x3E
+#define SIM_REGISTERS          0x50 //everything up to and including the protected setpoints
+#define SIM_HOP_DELAY_US       2    //time for a frame to pass through one board of the daisy chain
+#define SIM_TURNAROUND_US      30   //from the end of a request to the first reply bit on the addressed board
+#define SIM_CONVERSION_US      6    //per converted ADC channel
+#define SIM_FRAME_GAP_US       1000 //a partial request older than this is dropped, like the board's frame timeout
+
+/*
+ * Host side model of a daisy chain of Tesla module boards (bq76PL536 style monitors) sitting on the
+ * far end of SERIALBMS. It decodes the frames the firmware sends and answers them the way the boards
+ * do, with their timing, so BMSModuleManager can run unmodified on a PC:
+ *
+ * - every board starts unaddressed (address 0, POR fault, "address not registered" alert) and the
+ *   first unaddressed board in the chain answers address 0 with the top bit of the address set
+ * - writing REG_ADDR_CTRL with bit 7 set takes the address, broadcast 0x3C/0xA5 resets all boards
+ * - writes to the broadcast address 0x3F reach every board, one echo comes back from the end of the chain
+ * - write CRCs are checked (a bad one gets no reply and flags the CRC fault), replies carry a CRC
+ * - REG_ADC_CONV samples the cell voltages and temperatures set with setCellVoltage/setTemperature,
+ *   the result registers only change once the conversion time is over
+ * - replies start SIM_TURNAROUND_US plus SIM_HOP_DELAY_US per board each way after the request and
+ *   arrive byte by byte at the port's baud rate on the host virtual clock
+ *
+ * Board positions count from 0 (the board nearest to the master).
+ */
+class ModuleChainSim : public SerialPeer
+{
+public:
+    ModuleChainSim(int modules);
+
+    void attach(HardwareSerial &port);
+    void powerOn();                                 //every board back to its reset state
+
+    int getModuleCount();
+    void setCellVoltage(int position, int cell, float volts);
+    void setTemperature(int position, int sensor, float celsius);
+    float getCellVoltage(int position, int cell);
+    float getTemperature(int position, int sensor);
+    uint8_t getAddress(int position);
+    uint8_t getRegister(int position, uint8_t reg);
+    void setRegister(int position, uint8_t reg, uint8_t value); //e.g. force a fault or alert bit
+    void setNoise(int lsb);                         //random error added to every ADC result
+    void setTiming(uint32_t hopDelay, uint32_t turnaround, uint32_t conversion);
+    void setErrorRate(float rate);                  //fraction of replies that get one bit flipped
+
+    uint32_t getFrameCount();                       //requests decoded
+    uint32_t getCrcErrorCount();                    //write requests dropped for a bad CRC
+    uint32_t getCorruptedCount();                   //replies damaged because of setErrorRate
+    uint64_t getRequestBytes();                     //bytes on the wire towards the chain
+    uint64_t getReplyBytes();                       //and back
+
+    void receive(HardwareSerial &port, const uint8_t *data, size_t len);
+
+private:
+    struct Board
+    {
+        uint8_t regs[SIM_REGISTERS];
+        float cellVolt[6];
+        float temperature[2];
+        uint8_t result[0x12];                       //conversion in progress, copied to GPAI.. once done
+        uint64_t conversionDone;
+        bool converting;
+    };
+
+    std::vector<Board> boards;
+    uint8_t request[4];
+    int requestLen;
+    uint64_t lastByteAt;
+    uint64_t wireFreeAt;
+    uint32_t hopDelay;
+    uint32_t turnaround;
+    uint32_t conversionTime;
+    int noise;
+    float errorRate;
+    uint32_t seed;
+    uint32_t frameCount;
+    uint32_t crcErrors;
+    uint32_t corrupted;
+    uint64_t requestBytes;
+    uint64_t replyBytes;
+
+    void handleFrame(HardwareSerial &port, uint64_t endAt);
+    void resetBoard(Board &board);
+    void writeRegister(Board &board, uint8_t reg, uint8_t value, uint64_t now);
+    void startConversion(Board &board, uint64_t now);
+    void finishConversion(Board &board, uint64_t now);
+    void updateAlerts(Board &board);
+    uint16_t adcCode(float value);
+    uint32_t nextRandom();
+    void reply(HardwareSerial &port, uint8_t *frame, int len, int hops, uint64_t endAt);
+};
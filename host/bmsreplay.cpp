@@ -0,0 +1,433 @@
+/*
+ * Replays a bus capture (console command 'X', format at BMSModuleManager::startCapture) into the
+ * unmodified BMSModuleManager and checks that it decodes the same cell voltages, temperatures, fault
+ * flags and pack voltage as the device did when the capture was taken.
+ *
+ *   ./bmsreplay console.log [timing=original|fast] [check=1]
+ *
+ * A stand in for the module chain answers every request with the reply recorded for it. With
+ * original timing the replies come back with the recorded latency and scans start at the recorded
+ * intervals on the virtual clock, so timeouts and poll scheduling behave as they did in the field.
+ * Fast timing answers right after each request and runs the scans back to back. check=0 leaves the
+ * comparison (and the capture formatting it needs) out so the host time covers parsing and
+ * aggregation only.
+ *
+ * Requests the capture does not hold (e.g. the first configuration writes of a fresh manager) are
+ * answered with an echo if they are writes and left unanswered if they are reads. Exits non zero if
+ * any decoded value differs, if the device lost frames of the capture or if a read went unanswered:
+ * then the capture does not hold everything the replay needs and an OK would mean nothing.
+ */
+#include <Arduino.h>
+#include <chrono>
+#include <ctype.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include "HostClock.h"
+#include "BMSModuleManager.h"
+#include "BMSUtil.h"
+#include "Logger.h"
+
+HardwareSerial SERIALBMS(1);
+BMSModuleManager bms;
+String bms_status, bms_modules_text;
+EEPROMSettings settings;
+
+#define FAULT_PIN 11 //what getAllVoltTemp reads the fault line from
+
+//What the capture has delivered a good reading of so far, per module. The device may hold values
+//from before the capture started, those can only be compared once the replay got them too.
+#define SEEN_CELLS   1
+#define SEEN_TEMPS   2
+#define SEEN_STATUS  4
+
+struct Frame
+{
+    uint32_t timestamp;
+    int outcome;
+    int length;
+    std::vector<uint8_t> bytes;
+};
+
+struct Transaction
+{
+    Frame tx;
+    Frame rx;
+    bool haveReply;
+};
+
+struct ModuleValues
+{
+    int address;
+    float cells[6];
+    float temps[2];
+    float moduleVolt;
+    unsigned int alerts, faults, cov, cuv;
+};
+
+struct Scan
+{
+    uint32_t start;
+    unsigned long number;
+    int faultLine;
+    int lost;
+    int pstrings, tempCycles, statusCycles;
+    std::vector<Transaction> transactions;
+    std::vector<ModuleValues> modules;
+    float packVolt;
+    int faulted;
+    bool complete;                  //the E line was seen
+};
+
+//Parse one capture line (without the "CAP " prefix) into the scan it belongs to
+static void parseCaptureLine(const char *line, std::vector<Scan> &scans)
+{
+    Frame frame;
+    char direction;
+    unsigned long timestamp;
+    int used = 0;
+
+    if (line[0] == 'S')
+    {
+        Scan scan;
+        scan.lost = 0;
+        scan.pstrings = 1;
+        scan.tempCycles = BMS_TEMP_POLL_CYCLES;
+        scan.statusCycles = BMS_STATUS_POLL_CYCLES;
+        scan.packVolt = 0.0f;
+        scan.faulted = 0;
+        scan.complete = false;
+        if (sscanf(line, "S %lu %lu %d %d %d %d", &timestamp, &scan.number, &scan.faultLine,
+                   &scan.pstrings, &scan.tempCycles, &scan.statusCycles) < 3) return;
+        scan.start = (uint32_t)timestamp;
+        scans.push_back(scan);
+        return;
+    }
+    if (scans.empty() || scans.back().complete) return;
+    Scan &scan = scans.back();
+
+    if (line[0] == 'T' || line[0] == 'R')
+    {
+        if (sscanf(line, "%c %lu %d %d %n", &direction, &timestamp, &frame.outcome, &frame.length, &used) != 4 || used == 0) return;
+        frame.timestamp = (uint32_t)timestamp;
+        for (const char *hex = line + used; isxdigit(hex[0]) && isxdigit(hex[1]); hex += 2)
+        {
+            char pair[3] = {hex[0], hex[1], 0};
+            frame.bytes.push_back((uint8_t)strtoul(pair, NULL, 16));
+        }
+        if (direction == 'T')
+        {
+            Transaction t;
+            t.tx = frame;
+            t.haveReply = false;
+            scan.transactions.push_back(t);
+        }
+        else if (!scan.transactions.empty() && !scan.transactions.back().haveReply)
+        {
+            scan.transactions.back().rx = frame;
+            scan.transactions.back().haveReply = true;
+        }
+    }
+    else if (line[0] == 'M')
+    {
+        ModuleValues m;
+        if (sscanf(line, "M %d %f %f %f %f %f %f %f %f %f %x %x %x %x", &m.address, &m.cells[0], &m.cells[1], &m.cells[2],
+                   &m.cells[3], &m.cells[4], &m.cells[5], &m.temps[0], &m.temps[1], &m.moduleVolt,
+                   &m.alerts, &m.faults, &m.cov, &m.cuv) == 14) scan.modules.push_back(m);
+    }
+    else if (line[0] == 'E')
+    {
+        if (sscanf(line, "E %f %d %d", &scan.packVolt, &scan.faulted, &scan.lost) >= 2) scan.complete = true;
+    }
+}
+
+static void parseCapture(FILE *in, std::vector<Scan> &scans)
+{
+    char line[512];
+    const char *cap;
+
+    //the capture can sit anywhere in a console log, even behind a terminal timestamp
+    while (fgets(line, sizeof(line), in))
+    {
+        if ((cap = strstr(line, "CAP ")) != NULL) parseCaptureLine(cap + 4, scans);
+    }
+}
+
+/*
+ * Takes the place of the module chain on SERIALBMS. Each request is looked up in the current scan from
+ * where the last match was found, so retries get the reply recorded for that particular attempt.
+ */
+class ReplayPeer : public SerialPeer
+{
+public:
+    ReplayPeer()
+    {
+        scan = NULL;
+        cursor = 0;
+        originalTiming = true;
+        turnaround = 0;
+        matched = echoed = unanswered = 0;
+        memset(seen, 0, sizeof(seen));
+    }
+
+    void setTiming(bool original) { originalTiming = original; }
+    void setModules(const std::vector<ModuleValues> &modules) { present = modules; }
+
+    void setScan(const Scan *scan)
+    {
+        this->scan = scan;
+        cursor = 0;
+    }
+
+    //captured transactions the manager never asked for
+    size_t getLeftOver() { return scan ? scan->transactions.size() - cursor : 0; }
+
+    uint32_t matched;               //answered from the capture
+    uint32_t echoed;                //writes not in the capture, answered with an echo
+    uint32_t unanswered;            //reads not in the capture
+    uint8_t seen[MAX_MODULE_ADDR + 1];
+
+    void receive(HardwareSerial &port, const uint8_t *data, size_t len)
+    {
+        //BMSUtil hands over a whole frame per write
+        uint64_t requestEnd = HostClock::now() + len * port.getByteTime();
+
+        if (!scan)
+        {
+            answerProbe(port, data, len, requestEnd);
+            return;
+        }
+        for (size_t i = cursor; i < scan->transactions.size(); i++)
+        {
+            const Transaction &t = scan->transactions[i];
+            if (t.tx.bytes.size() != len || memcmp(t.tx.bytes.data(), data, len)) continue;
+            cursor = i + 1;
+            matched++;
+            if (!t.haveReply || t.rx.bytes.empty()) return;
+            if (t.rx.outcome == BMSUtil::REPLY_OK && !(data[0] & 1) && (data[0] >> 1) <= MAX_MODULE_ADDR)
+            {
+                if (data[1] == REG_GPAI) seen[data[0] >> 1] |= SEEN_CELLS;
+                if (data[1] == REG_GPAI && data[2] >= REG_TEMPERATURE2 + 2 - REG_GPAI) seen[data[0] >> 1] |= SEEN_TEMPS;
+                if (data[1] == REG_ALERT_STATUS) seen[data[0] >> 1] |= SEEN_STATUS;
+            }
+            uint64_t at = requestEnd;
+            if (originalTiming)
+            {
+                //a good reply is stamped when it was complete. Failed ones are stamped when the
+                //manager gave up on them, those start after the turnaround of the last good one.
+                uint64_t replyTime = (uint64_t)t.rx.bytes.size() * port.getByteTime();
+                uint32_t latency = t.rx.timestamp - t.tx.timestamp;
+                if (t.rx.outcome == BMSUtil::REPLY_OK && HostClock::now() + latency > requestEnd + replyTime)
+                {
+                    at = HostClock::now() + latency - replyTime;
+                    turnaround = at - requestEnd;
+                }
+                else if (t.rx.outcome != BMSUtil::REPLY_OK) at = requestEnd + turnaround;
+            }
+            port.inject(t.rx.bytes.data(), t.rx.bytes.size(), at);
+            return;
+        }
+        if (len == 4 && (data[0] & 1))
+        {
+            echoed++;
+            port.inject(data, len, requestEnd);
+        }
+        else unanswered++;
+    }
+
+private:
+    const Scan *scan;
+    size_t cursor;
+    bool originalTiming;
+    uint64_t turnaround;            //request end to reply start of the last good transaction
+    std::vector<ModuleValues> present;
+
+    //Before the first scan findBoards() probes for modules, answer for the ones the capture holds
+    void answerProbe(HardwareSerial &port, const uint8_t *data, size_t len, uint64_t requestEnd)
+    {
+        uint8_t reply[5];
+        if (len != 3 || (data[0] & 1) || data[1] != 0 || data[2] != 1) return;
+        for (size_t i = 0; i < present.size(); i++)
+        {
+            if (present[i].address != data[0] >> 1) continue;
+            reply[0] = data[0];
+            reply[1] = 0;
+            reply[2] = 1;
+            reply[3] = 0;
+            reply[4] = BMSCRC8::compute(reply, 4);
+            port.inject(reply, 5, requestEnd);
+            return;
+        }
+    }
+};
+
+//Collects what the replayed manager prints so its capture lines can be compared with the recorded ones
+class CaptureSink : public Print
+{
+public:
+    std::vector<Scan> scans;
+
+    size_t write(uint8_t c)
+    {
+        if (c == '\n')
+        {
+            if (line.compare(0, 4, "CAP ") == 0) parseCaptureLine(line.c_str() + 4, scans);
+            line.clear();
+        }
+        else if (c != '\r') line += (char)c;
+        return 1;
+    }
+
+private:
+    std::string line;
+};
+
+static int compareScan(const Scan &want, const Scan &got, int index, const uint8_t *seen)
+{
+    int mismatches = 0;
+    bool allSeen = true;
+    size_t g = 0;
+
+    for (size_t w = 0; w < want.modules.size(); w++)
+    {
+        const ModuleValues &a = want.modules[w];
+        while (g < got.modules.size() && got.modules[g].address < a.address) g++;
+        if (g == got.modules.size() || got.modules[g].address != a.address)
+        {
+            printf("scan %d module %d: not decoded by the replay\n", index, a.address);
+            mismatches++;
+            continue;
+        }
+        const ModuleValues &b = got.modules[g];
+        bool same = true;
+        if (seen[a.address] & SEEN_CELLS)
+        {
+            same = fabsf(a.moduleVolt - b.moduleVolt) < 0.00015f;
+            for (int c = 0; c < 6; c++) same = same && fabsf(a.cells[c] - b.cells[c]) < 0.00015f;
+        }
+        else allSeen = false;
+        if (seen[a.address] & SEEN_TEMPS)
+        {
+            for (int t = 0; t < 2; t++) same = same && fabsf(a.temps[t] - b.temps[t]) < 0.015f;
+        }
+        if (seen[a.address] & SEEN_STATUS)
+        {
+            same = same && a.alerts == b.alerts && a.faults == b.faults && a.cov == b.cov && a.cuv == b.cuv;
+        }
+        if (same) continue;
+        printf("scan %d module %d differs\n  captured %.4f %.4f %.4f %.4f %.4f %.4f %.2f %.2f %.4f %02X %02X %02X %02X\n", index, a.address,
+               a.cells[0], a.cells[1], a.cells[2], a.cells[3], a.cells[4], a.cells[5], a.temps[0], a.temps[1], a.moduleVolt,
+               a.alerts, a.faults, a.cov, a.cuv);
+        printf("  replayed %.4f %.4f %.4f %.4f %.4f %.4f %.2f %.2f %.4f %02X %02X %02X %02X\n",
+               b.cells[0], b.cells[1], b.cells[2], b.cells[3], b.cells[4], b.cells[5], b.temps[0], b.temps[1], b.moduleVolt,
+               b.alerts, b.faults, b.cov, b.cuv);
+        mismatches++;
+    }
+    if ((allSeen && fabsf(want.packVolt - got.packVolt) > 0.0005f) || want.faulted != got.faulted)
+    {
+        printf("scan %d pack: captured %.4fV faulted %d, replayed %.4fV faulted %d\n", index, want.packVolt, want.faulted,
+               got.packVolt, got.faulted);
+        mismatches++;
+    }
+    return mismatches;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<Scan> scans;
+    ReplayPeer peer;
+    CaptureSink sink;
+    bool originalTiming = true;
+    bool check = true;
+    FILE *in;
+    int mismatches = 0;
+    size_t first = 0, frames = 0, leftOver = 0, lost = 0;
+    uint64_t replayStart, busTime = 0, start;
+    double hostNs = 0.0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s capture.log [timing=original|fast] [check=1]\n", argv[0]);
+        return 2;
+    }
+    for (int i = 2; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "timing=fast")) originalTiming = false;
+        else if (!strcmp(argv[i], "timing=original")) originalTiming = true;
+        else if (!strncmp(argv[i], "check=", 6)) check = atoi(argv[i] + 6) != 0;
+        else
+        {
+            fprintf(stderr, "unknown argument %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (!(in = fopen(argv[1], "r")))
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    parseCapture(in, scans);
+    fclose(in);
+    while (!scans.empty() && !scans.back().complete) scans.pop_back(); //log cut off mid scan
+
+    //the poll tiers only line up from the scan capture mode was switched on at
+    while (first < scans.size() && scans[first].number != 0) first++;
+    if (first == scans.size())
+    {
+        fprintf(stderr, "%s: no capture starting at scan 0 found\n", argv[1]);
+        return 1;
+    }
+
+    SERIALBMS.begin(612500, SERIAL_8N1);
+    BMSUtil::begin();
+    Logger::setLoglevel(Logger::Off);
+    peer.setTiming(originalTiming);
+    peer.setModules(scans[first].modules);
+    SERIALBMS.attach(&peer);
+
+    bms.findBoards();
+    bms.setPstrings(scans[first].pstrings);
+    bms.setPollCycles(scans[first].tempCycles, scans[first].statusCycles);
+    bms.setCapture(true);               //restarts the scan count
+    if (!check) bms.setCapture(false);
+    Logger::setOutput(&sink);
+
+    replayStart = HostClock::now();
+    for (size_t i = first; i < scans.size(); i++)
+    {
+        const Scan &scan = scans[i];
+        uint64_t due = replayStart + (uint32_t)(scan.start - scans[first].start);
+        if (originalTiming && due > HostClock::now()) HostClock::advanceTo(due);
+
+        digitalWrite(FAULT_PIN, scan.faultLine ? LOW : HIGH);
+        peer.setScan(&scan);
+        std::chrono::steady_clock::time_point hostStart = std::chrono::steady_clock::now();
+        start = HostClock::now();
+        bms.getAllVoltTemp();
+        busTime += HostClock::now() - start;
+        hostNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - hostStart).count();
+
+        frames += scan.transactions.size();
+        leftOver += peer.getLeftOver();
+        lost += scan.lost;
+        if (check) mismatches += compareScan(scan, sink.scans.back(), (int)(i - first), peer.seen);
+    }
+    Logger::setOutput(NULL);
+
+    size_t replayed = scans.size() - first;
+    printf("replayed %lu scans, %lu captured transactions (%lu lost by the device trace buffer)\n", (unsigned long)replayed,
+           (unsigned long)frames, (unsigned long)lost);
+    printf("answered from capture %lu, echoed writes %lu, unanswered reads %lu, captured but not asked for %lu\n",
+           (unsigned long)peer.matched, (unsigned long)peer.echoed, (unsigned long)peer.unanswered, (unsigned long)leftOver);
+    printf("bus time %.2f ms per scan (virtual, %s timing), host %.1f us per scan, %.0f ns per transaction\n",
+           busTime / 1000.0 / replayed, originalTiming ? "original" : "fast", hostNs / 1000.0 / replayed,
+           peer.matched ? hostNs / peer.matched : 0.0);
+    if (lost || peer.unanswered)
+    {
+        printf("FAIL: incomplete capture, %lu frames lost, %lu reads unanswered\n", (unsigned long)lost,
+               (unsigned long)peer.unanswered);
+        return 1;
+    }
+    if (check) printf("%s: %d mismatches\n", mismatches ? "FAIL" : "OK", mismatches);
+    return mismatches ? 1 : 0;
+}
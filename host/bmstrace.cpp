@@ -0,0 +1,212 @@
+/*
+ * Decoder for the bus trace printed by the 'T' console command (BMSTrace::dump).
+ *
+ *   c++ -O2 -std=gnu++11 -I.. bmstrace.cpp ../BMSCrc.cpp -o bmstrace
+ *   ./bmstrace console.log        (or pipe the log in on stdin)
+ *
+ * Pairs every request with its reply and prints one line per transaction with the
+ * latency, followed by per-module totals. Anything in the log outside the
+ * TRACE BEGIN / TRACE END block is ignored.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "BMSCrc.h"
+
+struct Entry
+{
+    char direction;
+    uint32_t timestamp;
+    int outcome;
+    int length;
+    std::vector<uint8_t> bytes;
+};
+
+struct ModuleTotals
+{
+    int transactions;
+    int good;
+    int failed[5];
+    uint32_t latencyMin;
+    uint32_t latencyMax;
+    uint64_t latencySum;
+};
+
+static const char *outcomeName(int outcome)
+{
+    switch (outcome)
+    {
+    case 0: return "ok";
+    case 1: return "timeout";
+    case 2: return "short";
+    case 3: return "bad-header";
+    case 4: return "bad-crc";
+    case 255: return "raw";
+    }
+    return "?";
+}
+
+static const char *registerName(uint8_t reg)
+{
+    switch (reg)
+    {
+    case 0x00: return "DEVICE_STATUS";
+    case 0x01: return "GPAI";
+    case 0x03: return "VCELL1";
+    case 0x05: return "VCELL2";
+    case 0x07: return "VCELL3";
+    case 0x09: return "VCELL4";
+    case 0x0B: return "VCELL5";
+    case 0x0D: return "VCELL6";
+    case 0x0F: return "TEMPERATURE1";
+    case 0x11: return "TEMPERATURE2";
+    case 0x20: return "ALERT_STATUS";
+    case 0x21: return "FAULT_STATUS";
+    case 0x22: return "COV_FAULT";
+    case 0x23: return "CUV_FAULT";
+    case 0x30: return "ADC_CTRL";
+    case 0x31: return "IO_CTRL";
+    case 0x32: return "BAL_CTRL";
+    case 0x33: return "BAL_TIME";
+    case 0x34: return "ADC_CONV";
+    case 0x3B: return "ADDR_CTRL";
+    case 0x3C: return "RESET";
+    }
+    return "?";
+}
+
+static bool parseLine(const char *line, Entry &entry)
+{
+    char direction;
+    unsigned long timestamp;
+    int outcome, length, used = 0;
+    const char *hex;
+
+    if (sscanf(line, " %c %lu %d %d %n", &direction, &timestamp, &outcome, &length, &used) != 4 || used == 0) return false;
+    if (direction != 'T' && direction != 'R') return false;
+    entry.direction = direction;
+    entry.timestamp = (uint32_t)timestamp;
+    entry.outcome = outcome;
+    entry.length = length;
+    entry.bytes.clear();
+    for (hex = line + used; hex[0] && hex[1] && hex[0] != '\r' && hex[0] != '\n'; hex += 2)
+    {
+        char pair[3] = {hex[0], hex[1], 0};
+        entry.bytes.push_back((uint8_t)strtoul(pair, NULL, 16));
+    }
+    return true;
+}
+
+static std::string hexString(const std::vector<uint8_t> &bytes)
+{
+    std::string out;
+    char tmp[4];
+    for (size_t x = 0; x < bytes.size(); x++)
+    {
+        snprintf(tmp, sizeof(tmp), x ? " %02X" : "%02X", bytes[x]);
+        out += tmp;
+    }
+    return out;
+}
+
+//Cell and module voltages out of a good GPAI reply, same scaling as BMSModule
+static std::string decodeGPAI(const std::vector<uint8_t> &reply)
+{
+    std::string out;
+    char tmp[32];
+    if (reply.size() < 18 || reply[1] != 0x01) return out;
+    snprintf(tmp, sizeof(tmp), "  module %.3fV cells", (reply[3] * 256 + reply[4]) * 0.002034609f);
+    out += tmp;
+    for (int i = 0; i < 6; i++)
+    {
+        snprintf(tmp, sizeof(tmp), " %.3f", (reply[5 + i * 2] * 256 + reply[6 + i * 2]) * 0.000381493f);
+        out += tmp;
+    }
+    return out;
+}
+
+int main(int argc, char **argv)
+{
+    FILE *in = stdin;
+    char line[512];
+    bool inTrace = false;
+    std::vector<Entry> entries;
+    std::map<int, ModuleTotals> totals;
+    Entry entry;
+
+    if (argc > 1 && !(in = fopen(argv[1], "r")))
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    //a log can hold several dumps, the last one wins
+    while (fgets(line, sizeof(line), in))
+    {
+        if (strstr(line, "TRACE BEGIN"))
+        {
+            entries.clear();
+            inTrace = true;
+        }
+        else if (strstr(line, "TRACE END")) inTrace = false;
+        else if (inTrace && parseLine(line, entry)) entries.push_back(entry);
+    }
+    if (in != stdin) fclose(in);
+
+    printf("%10s %9s %6s %5s %-14s %4s %-10s  %s\n", "time(us)", "latency", "module", "op", "register", "val", "result", "request | reply");
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const Entry &tx = entries[i];
+        const Entry *rx = NULL;
+        if (tx.direction != 'T' || tx.bytes.size() < 3) continue;
+        if (i + 1 < entries.size() && entries[i + 1].direction == 'R') rx = &entries[++i];
+
+        bool isWrite = tx.bytes[0] & 1;
+        int address = tx.bytes[0] >> 1;
+        uint32_t latency = rx ? rx->timestamp - tx.timestamp : 0;
+        int outcome = rx ? rx->outcome : 1;
+        char module[8];
+
+        if (address == 0x3F) strcpy(module, "all");
+        else snprintf(module, sizeof(module), "%d", address);
+
+        //replies read without the parser: judge them the way the parser would have
+        if (rx && outcome == 255)
+        {
+            outcome = (rx->bytes.size() >= 4 && BMSCRC8::compute(rx->bytes.data(), rx->bytes.size() - 1) == rx->bytes.back()) ? 0 : 2;
+            if (rx->bytes.empty()) outcome = 1;
+        }
+
+        printf("%10lu %7luus %6s %5s %-14s %4d %-10s  %s | %s%s\n", (unsigned long)tx.timestamp, (unsigned long)latency,
+               module, isWrite ? "write" : "read", registerName(tx.bytes[1]), tx.bytes[2], outcomeName(outcome),
+               hexString(tx.bytes).c_str(), rx ? hexString(rx->bytes).c_str() : "-",
+               (rx && outcome == 0) ? decodeGPAI(rx->bytes).c_str() : "");
+
+        ModuleTotals &t = totals[address];
+        t.transactions++;
+        if (outcome == 0)
+        {
+            if (t.good == 0 || latency < t.latencyMin) t.latencyMin = latency;
+            if (latency > t.latencyMax) t.latencyMax = latency;
+            t.latencySum += latency;
+            t.good++;
+        }
+        else if (outcome >= 1 && outcome <= 4) t.failed[outcome]++;
+    }
+
+    printf("\n%6s %6s %6s %8s %6s %10s %8s   %s\n", "module", "trans", "good", "timeout", "short", "bad-header", "bad-crc", "latency us min/avg/max");
+    for (std::map<int, ModuleTotals>::iterator it = totals.begin(); it != totals.end(); ++it)
+    {
+        const ModuleTotals &t = it->second;
+        char module[8];
+        if (it->first == 0x3F) strcpy(module, "all");
+        else snprintf(module, sizeof(module), "%d", it->first);
+        printf("%6s %6d %6d %8d %6d %10d %8d   %lu / %lu / %lu\n", module, t.transactions, t.good, t.failed[1], t.failed[2],
+               t.failed[3], t.failed[4], (unsigned long)t.latencyMin,
+               (unsigned long)(t.good ? t.latencySum / t.good : 0), (unsigned long)t.latencyMax);
+    }
+    return 0;
+}
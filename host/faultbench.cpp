@@ -0,0 +1,190 @@
+/*
+ * How well the acquisition path copes with a glitchy bus. For each fault mix the simulated chain is
+ * enumerated on a clean link, then scanned with FaultInjector damaging the traffic. Every transaction
+ * is taken from the bus trace (BMSTrace) and every accepted GPAI reply is checked against the result
+ * registers of the board it came from.
+ *
+ *   ./faultbench [modules=8] [scans=500] [seed=1]                  all built in mixes
+ *   ./faultbench drop=0.001 corrupt=0.001 delay=0.01 delayus=300 requests=1     one custom mix
+ *
+ * Columns: cell samples per second of bus time that made it through correct (goodput) and the same
+ * for a clean link, latency percentiles of the successful transactions, failed transactions by
+ * outcome, and accepted GPAI replies that did not hold what the board sent (false accepts).
+ */
+#include <Arduino.h>
+#include <algorithm>
+#include <vector>
+#include "HostClock.h"
+#include "ModuleChainSim.h"
+#include "FaultInjector.h"
+#include "BMSModuleManager.h"
+#include "BMSUtil.h"
+#include "Logger.h"
+
+HardwareSerial SERIALBMS(1);
+String bms_status, bms_modules_text;
+EEPROMSettings settings;
+
+struct MixResult
+{
+    uint64_t busTime;
+    uint32_t goodCells;
+    uint32_t outcomes[5];       //BMSUtil::Result
+    uint32_t accepted;          //GPAI replies that passed the parser
+    uint32_t falseAccepts;
+    std::vector<uint32_t> latencies;
+};
+
+//Walk the trace of one scan, pairing each request with its reply
+static void collect(ModuleChainSim &chain, MixResult &result)
+{
+    BMSTraceEntry tx, rx;
+    int count = BMSTrace::getCount();
+
+    for (int i = 0; i + 1 < count; i++)
+    {
+        if (!BMSTrace::getEntry(i, tx) || tx.direction != BMS_TRACE_TX) continue;
+        if (!BMSTrace::getEntry(i + 1, rx) || rx.direction != BMS_TRACE_RX || rx.outcome == BMS_TRACE_RAW) continue;
+        i++;
+        if (rx.outcome < 5) result.outcomes[rx.outcome]++;
+        if (rx.outcome != BMSUtil::REPLY_OK) continue;
+        result.latencies.push_back(rx.timestamp - tx.timestamp);
+
+        if ((tx.bytes[0] & 1) || tx.bytes[1] != REG_GPAI) continue;
+        int position = (tx.bytes[0] >> 1) - 1;
+        bool match = chain.getAddress(position) == (tx.bytes[0] >> 1);
+        for (int b = 0; match && b < tx.bytes[2] && 3 + b < BMS_TRACE_MAX_BYTES; b++)
+        {
+            if (rx.bytes[3 + b] != chain.getRegister(position, REG_GPAI + b)) match = false;
+        }
+        result.accepted++;
+        if (match) result.goodCells += 6;
+        else result.falseAccepts++;
+    }
+    BMSTrace::clear();
+}
+
+static MixResult runMix(int modules, int scans, uint32_t seed, const FaultMix &mix)
+{
+    ModuleChainSim chain(modules);
+    FaultInjector wire(chain);
+    BMSModuleManager *bms = new BMSModuleManager();
+    FaultMix clean;
+    MixResult result;
+    uint64_t start;
+
+    memset(&clean, 0, sizeof(clean));
+    result.busTime = 0;
+    result.goodCells = 0;
+    result.accepted = 0;
+    result.falseAccepts = 0;
+    memset(result.outcomes, 0, sizeof(result.outcomes));
+
+    for (int m = 0; m < modules; m++)
+    {
+        for (int c = 0; c < 6; c++) chain.setCellVoltage(m, c, 3.60f + 0.013f * ((m * 6 + c) % 9));
+    }
+    wire.attach(SERIALBMS);
+    wire.setSeed(seed);
+    wire.setMix(clean);
+    bms->renumberBoardIDs();
+    bms->findBoards();
+    bms->setPstrings(1);
+    bms->clearFaults();
+    wire.setMix(mix);
+
+    BMSTrace::clear();
+    for (int i = 0; i < scans; i++)
+    {
+        start = HostClock::now();
+        bms->getAllVoltTemp();
+        result.busTime += HostClock::now() - start;
+        collect(chain, result);
+    }
+    delete bms;
+    std::sort(result.latencies.begin(), result.latencies.end());
+    return result;
+}
+
+static uint32_t percentile(const std::vector<uint32_t> &sorted, int pct)
+{
+    if (sorted.empty()) return 0;
+    return sorted[(sorted.size() - 1) * pct / 100];
+}
+
+static void report(const char *name, const MixResult &result, double cleanGoodput)
+{
+    double goodput = result.goodCells * 1000000.0 / result.busTime;
+    printf("%s,%.0f,%.3f,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%.2e\n", name, goodput, goodput / cleanGoodput,
+           (unsigned long)percentile(result.latencies, 50), (unsigned long)percentile(result.latencies, 90),
+           (unsigned long)percentile(result.latencies, 99), (unsigned long)percentile(result.latencies, 100),
+           (unsigned long)result.outcomes[BMSUtil::REPLY_TIMEOUT], (unsigned long)result.outcomes[BMSUtil::REPLY_SHORT],
+           (unsigned long)result.outcomes[BMSUtil::REPLY_BAD_HEADER], (unsigned long)result.outcomes[BMSUtil::REPLY_BAD_CRC],
+           (unsigned long)result.accepted, (unsigned long)result.falseAccepts,
+           result.accepted ? (double)result.falseAccepts / result.accepted : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+    struct NamedMix
+    {
+        const char *name;
+        FaultMix mix;
+    };
+    //drop, corrupt, duplicate, delay, truncate, delay us, requests too
+    std::vector<NamedMix> mixes = {
+        {"drop", {0.001f, 0, 0, 0, 0, 0, false}},
+        {"corrupt", {0, 0.001f, 0, 0, 0, 0, false}},
+        {"duplicate", {0, 0, 0.001f, 0, 0, 0, false}},
+        {"delay", {0, 0, 0, 0.01f, 0, 300, false}},
+        {"truncate", {0, 0, 0, 0, 0.002f, 0, false}},
+        {"requests", {0.001f, 0.001f, 0.001f, 0, 0.002f, 0, true}},
+        {"mixed", {0.001f, 0.001f, 0.001f, 0.01f, 0.002f, 300, true}},
+        {"harsh", {0.01f, 0.01f, 0.01f, 0.05f, 0.02f, 1000, true}},
+    };
+    NamedMix custom = {"custom", {0, 0, 0, 0, 0, 300, false}};
+    bool haveCustom = false;
+    int modules = 8, scans = 500;
+    uint32_t seed = 1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *value = strchr(argv[i], '=');
+        if (!value)
+        {
+            fprintf(stderr, "usage: %s [modules=N] [scans=N] [seed=N] [drop= corrupt= duplicate= delay= truncate= delayus= requests=]\n", argv[0]);
+            return 2;
+        }
+        value++;
+        if (!strncmp(argv[i], "modules=", 8)) modules = atoi(value);
+        else if (!strncmp(argv[i], "scans=", 6)) scans = atoi(value);
+        else if (!strncmp(argv[i], "seed=", 5)) seed = atoi(value);
+        else
+        {
+            haveCustom = true;
+            if (!strncmp(argv[i], "drop=", 5)) custom.mix.drop = atof(value);
+            else if (!strncmp(argv[i], "corrupt=", 8)) custom.mix.corrupt = atof(value);
+            else if (!strncmp(argv[i], "duplicate=", 10)) custom.mix.duplicate = atof(value);
+            else if (!strncmp(argv[i], "delay=", 6)) custom.mix.delay = atof(value);
+            else if (!strncmp(argv[i], "truncate=", 9)) custom.mix.truncate = atof(value);
+            else if (!strncmp(argv[i], "delayus=", 8)) custom.mix.delayUs = atoi(value);
+            else if (!strncmp(argv[i], "requests=", 9)) custom.mix.requests = atoi(value) != 0;
+        }
+    }
+    if (modules < 1 || modules > SIM_MAX_MODULES) modules = 8;
+    if (scans < 1) scans = 1;
+    if (haveCustom) mixes.assign(1, custom);
+
+    SERIALBMS.begin(612500, SERIAL_8N1);
+    BMSUtil::begin();
+    Logger::setLoglevel(Logger::Off);
+
+    NamedMix none = {"clean", {0, 0, 0, 0, 0, 0, false}};
+    MixResult clean = runMix(modules, scans, seed, none.mix);
+    double cleanGoodput = clean.goodCells * 1000000.0 / clean.busTime;
+
+    printf("mix,goodput_cells_per_s,vs_clean,lat_p50_us,lat_p90_us,lat_p99_us,lat_max_us,timeouts,short,bad_header,bad_crc,accepted,false_accepts,false_accept_rate\n");
+    report(none.name, clean, cleanGoodput);
+    for (size_t i = 0; i < mixes.size(); i++) report(mixes[i].name, runMix(modules, scans, seed, mixes[i].mix), cleanGoodput);
+    return 0;
+}
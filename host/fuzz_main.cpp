@@ -0,0 +1,76 @@
+/*
+ * Stand in for libFuzzer when the host build is not done with clang (-DBMS_LIBFUZZER=OFF). No coverage
+ * guidance, but it runs the same target:
+ *
+ *   ./fuzz_replies crash-file ...             replay inputs, e.g. a libFuzzer corpus or crash
+ *   ./fuzz_replies [runs=10000] [seed=1]      random inputs
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+#define FUZZ_MAX_INPUT 1024
+
+static uint32_t seed = 1;
+
+static uint32_t nextRandom()
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static int runFile(const char *path)
+{
+    std::vector<uint8_t> data;
+    uint8_t chunk[4096];
+    size_t got;
+    FILE *in = fopen(path, "rb");
+
+    if (!in)
+    {
+        perror(path);
+        return 1;
+    }
+    while ((got = fread(chunk, 1, sizeof(chunk), in)) > 0) data.insert(data.end(), chunk, chunk + got);
+    fclose(in);
+    LLVMFuzzerTestOneInput(data.data(), data.size());
+    printf("%s: %lu bytes ok\n", path, (unsigned long)data.size());
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t data[FUZZ_MAX_INPUT];
+    long runs = 10000;
+    int files = 0, failed = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strncmp(argv[i], "runs=", 5)) runs = atol(argv[i] + 5);
+        else if (!strncmp(argv[i], "seed=", 5)) seed = strtoul(argv[i] + 5, NULL, 0);
+        else
+        {
+            failed += runFile(argv[i]);
+            files++;
+        }
+    }
+    if (files > 0) return failed ? 1 : 0;
+
+    //step bytes are mostly well formed replies, raw noise alone hardly ever gets past the header checks
+    for (long r = 0; r < runs; r++)
+    {
+        size_t size = nextRandom() % FUZZ_MAX_INPUT;
+        for (size_t i = 0; i < size; i++)
+        {
+            data[i] = nextRandom();
+            if ((nextRandom() & 3) != 0) data[i] = (data[i] & 0x0F) | 0x40;
+        }
+        LLVMFuzzerTestOneInput(data, size);
+    }
+    printf("%ld random inputs ok\n", runs);
+    return 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * libFuzzer target for everything that takes module replies off the wire: board enumeration
+ * (renumberBoardIDs, setupBoards, findBoards), the pack scan, the single module read
+ * (readModuleValues) and balancing. Build with -DBMS_LIBFUZZER=ON using clang, or without it to get
+ * the standalone driver in fuzz_main.cpp (runs corpus files or random inputs, any compiler). Combine
+ * with -DBMS_SANITIZE=ON.
+ *
+ * The input is a script of what the chain answers. Every frame the firmware sends takes the next
+ * step from it, the top two bits of the step byte pick what comes back:
+ *   00 LLLLLL   the next L input bytes as they are
+ *   01 HGxxxx   a well formed reply to the request (data bytes from the input, CRC computed), with
+ *               the address top bit set if H, delayed past the reply timeout if G
+ *   10 ------   nothing
+ *   11 PPPPPP   a well formed reply with the byte at P (mod length) XORed with the next input byte
+ * Once the input runs out the chain goes quiet, so every run ends.
+ */
+#include <Arduino.h>
+#include "HostClock.h"
+#include "BMSModuleManager.h"
+#include "BMSUtil.h"
+#include "Logger.h"
+
+HardwareSerial SERIALBMS(1);
+String bms_status, bms_modules_text;
+EEPROMSettings settings;
+
+#define FUZZ_MAX_REPLY  80      //longest read the firmware asks for is 0x12 data bytes
+#define FUZZ_LATE_US    10000   //beyond any reply timeout in BMSUtil::transact
+
+class FuzzChain : public SerialPeer
+{
+public:
+    void begin(const uint8_t *data, size_t size)
+    {
+        input = data;
+        left = size;
+    }
+
+    void receive(HardwareSerial &port, const uint8_t *data, size_t len)
+    {
+        uint8_t reply[FUZZ_MAX_REPLY];
+        uint64_t at = HostClock::now() + (len + 2) * port.getByteTime();
+        size_t replyLen = 0;
+        uint8_t step;
+
+        if (!next(step)) return;
+        switch (step >> 6)
+        {
+        case 0:
+            while (replyLen < (size_t)(step & 0x3F) && next(reply[replyLen])) replyLen++;
+            break;
+        case 1:
+            replyLen = wellFormed(data, len, reply);
+            if (step & 0x20) reply[0] |= 0x80;
+            if (step & 0x10) at += FUZZ_LATE_US;
+            if (replyLen > 0) reply[replyLen - 1] = BMSCRC8::compute(reply, replyLen - 1);
+            break;
+        case 2:
+            break;
+        case 3:
+            replyLen = wellFormed(data, len, reply);
+            if (replyLen > 0)
+            {
+                uint8_t flip = 0;
+                reply[replyLen - 1] = BMSCRC8::compute(reply, replyLen - 1);
+                next(flip);
+                reply[(step & 0x3F) % replyLen] ^= flip;
+            }
+            break;
+        }
+        if (replyLen > 0) port.inject(reply, replyLen, at);
+    }
+
+private:
+    const uint8_t *input;
+    size_t left;
+
+    bool next(uint8_t &byte)
+    {
+        if (left == 0) return false;
+        byte = *input++;
+        left--;
+        return true;
+    }
+
+    //Header of the request, data bytes from the input for reads, room for the CRC at the end
+    size_t wellFormed(const uint8_t *request, size_t len, uint8_t *reply)
+    {
+        size_t replyLen;
+        if (len < 3) return 0;
+        memcpy(reply, request, 3);
+        if (request[0] & 1) return 4;
+        replyLen = request[2] + 4;
+        if (replyLen > FUZZ_MAX_REPLY) replyLen = FUZZ_MAX_REPLY;
+        for (size_t i = 3; i < replyLen - 1; i++)
+        {
+            if (!next(reply[i])) reply[i] = 0;
+        }
+        return replyLen;
+    }
+};
+
+static FuzzChain chain;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static bool ready = false;
+    if (!ready)
+    {
+        SERIALBMS.begin(612500, SERIAL_8N1);
+        BMSUtil::begin();
+        Logger::setLoglevel(Logger::Off);
+        SERIALBMS.attach(&chain);
+        ready = true;
+    }
+
+    //whatever the last run left on the line must not leak into this one
+    HostClock::advance(FUZZ_LATE_US);
+    while (SERIALBMS.available()) SERIALBMS.read();
+    BMSTrace::clear();
+    chain.begin(data, size);
+
+    BMSModuleManager *bms = new BMSModuleManager();
+    bms->renumberBoardIDs();
+    bms->findBoards();
+    bms->setPstrings(1);
+    bms->getAllVoltTemp();
+    bms->getAllVoltTemp();
+    bms->balanceCells();
+    delete bms;
+
+    BMSModule module;
+    module.setAddress(1);
+    module.setExists(true);
+    module.readModuleValues(true, true);
+    module.readModuleValues(false, false);
+    return 0;
+}
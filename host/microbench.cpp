@@ -0,0 +1,49 @@
+/*
+ * Host run of the Benchmark suite (the 'M' console command on the target). The pack aggregation
+ * benchmarks need modules, so a simulated chain is enumerated and scanned once first.
+ *
+ *   ./microbench [modules 1-62]
+ *
+ * Results are printed as BENCH,<name>,<iterations>,<cycles per operation> lines. "Cycles" are
+ * whatever ESP.getCycleCount() counts on the host: the TSC on x86, nanoseconds elsewhere.
+ */
+#include <Arduino.h>
+#include "ModuleChainSim.h"
+#include "BMSModuleManager.h"
+#include "BMSUtil.h"
+#include "Benchmark.h"
+#include "Logger.h"
+
+HardwareSerial SERIALBMS(1);
+BMSModuleManager bms;
+String bms_status, bms_modules_text;
+EEPROMSettings settings;
+
+int main(int argc, char **argv)
+{
+    int modules = (argc > 1) ? atoi(argv[1]) : BMS_NUM_SERIES;
+
+    if (modules < 1 || modules > SIM_MAX_MODULES)
+    {
+        fprintf(stderr, "usage: %s [modules 1-%d]\n", argv[0], SIM_MAX_MODULES);
+        return 2;
+    }
+
+    ModuleChainSim chain(modules);
+    for (int m = 0; m < modules; m++)
+    {
+        for (int c = 0; c < 6; c++) chain.setCellVoltage(m, c, 3.70f + 0.005f * ((m + c) % 9));
+    }
+    chain.attach(SERIALBMS);
+    SERIALBMS.begin(612500, SERIAL_8N1);
+    BMSUtil::begin();
+    Logger::setLoglevel(Logger::Off);
+
+    bms.renumberBoardIDs();
+    bms.findBoards();
+    bms.setPstrings(1);
+    bms.getAllVoltTemp();
+
+    Benchmark::run(bms);
+    return 0;
+}
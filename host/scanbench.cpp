@@ -0,0 +1,128 @@
+/*
+ * End to end scan benchmark: BMSModuleManager::getAllVoltTemp() against the simulated chain for every
+ * combination of the given module counts, baud rates, reply latencies and error rates. One CSV line
+ * per combination, so the scaling curve of two firmware versions can be compared with diff or a
+ * spreadsheet.
+ *
+ *   ./scanbench modules=1,2,4,8,16,32,62 baud=612500 latency=30 errors=0 scans=50 label=baseline
+ *
+ * latency is the turnaround of a board in us, errors the fraction of replies with a flipped bit.
+ * Columns: scan time in bus (virtual) us, share of that time the wire was busy, how often each cell
+ * gets sampled per second if scans ran back to back, frames sent per scan (retries show up here)
+ * and whether the pack voltage still came out right.
+ */
+#include <Arduino.h>
+#include <vector>
+#include "HostClock.h"
+#include "ModuleChainSim.h"
+#include "BMSModuleManager.h"
+#include "BMSUtil.h"
+#include "Logger.h"
+
+HardwareSerial SERIALBMS(1);
+String bms_status, bms_modules_text;
+EEPROMSettings settings;
+
+static std::vector<float> parseList(const char *text)
+{
+    std::vector<float> values;
+    char *end;
+    while (*text)
+    {
+        values.push_back(strtof(text, &end));
+        if (end == text) break;
+        text = (*end == ',') ? end + 1 : end;
+    }
+    return values;
+}
+
+static void runCase(const char *label, int modules, unsigned long baud, uint32_t latency, float errors, int scans)
+{
+    ModuleChainSim chain(modules);
+    BMSModuleManager *bms = new BMSModuleManager();
+    float expected = 0.0f;
+    uint64_t start, took, sum = 0, max = 0, wireBytes;
+    uint32_t frames;
+
+    for (int m = 0; m < modules; m++)
+    {
+        for (int c = 0; c < 6; c++)
+        {
+            chain.setCellVoltage(m, c, 3.65f + 0.01f * ((m * 6 + c) % 7));
+            expected += chain.getCellVoltage(m, c);
+        }
+    }
+    chain.setTiming(SIM_HOP_DELAY_US, latency, SIM_CONVERSION_US);
+    chain.attach(SERIALBMS);
+    SERIALBMS.begin(baud, SERIAL_8N1);
+
+    //enumerate on a clean link, the errors are for the scans
+    bms->renumberBoardIDs();
+    bms->findBoards();
+    bms->setPstrings(1);
+    bms->clearFaults();
+    chain.setErrorRate(errors);
+
+    frames = chain.getFrameCount();
+    wireBytes = chain.getRequestBytes() + chain.getReplyBytes();
+    for (int i = 0; i < scans; i++)
+    {
+        start = HostClock::now();
+        bms->getAllVoltTemp();
+        took = HostClock::now() - start;
+        sum += took;
+        if (took > max) max = took;
+    }
+    frames = chain.getFrameCount() - frames;
+    wireBytes = chain.getRequestBytes() + chain.getReplyBytes() - wireBytes;
+
+    double avg = (double)sum / scans;
+    double busy = (double)wireBytes * SERIALBMS.getByteTime() / sum;
+    bool packOk = fabsf(bms->getPackVoltage() - expected) < modules * 0.01f;
+    printf("%s,%d,%lu,%lu,%g,%.0f,%lu,%.3f,%.2f,%.1f,%d\n", label, modules, baud, (unsigned long)latency, errors, avg,
+           (unsigned long)max, busy, 1000000.0 / avg, (double)frames / scans, packOk ? 1 : 0);
+    delete bms;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<float> modules = parseList("1,2,4,8,16,32,62");
+    std::vector<float> bauds = parseList("612500");
+    std::vector<float> latencies = parseList("30");
+    std::vector<float> errors = parseList("0");
+    const char *label = "current";
+    int scans = 50;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *value = strchr(argv[i], '=');
+        if (!value)
+        {
+            fprintf(stderr, "usage: %s [modules=1,2,..] [baud=..] [latency=..] [errors=..] [scans=N] [label=text]\n", argv[0]);
+            return 2;
+        }
+        value++;
+        if (!strncmp(argv[i], "modules=", 8)) modules = parseList(value);
+        else if (!strncmp(argv[i], "baud=", 5)) bauds = parseList(value);
+        else if (!strncmp(argv[i], "latency=", 8)) latencies = parseList(value);
+        else if (!strncmp(argv[i], "errors=", 7)) errors = parseList(value);
+        else if (!strncmp(argv[i], "scans=", 6)) scans = atoi(value);
+        else if (!strncmp(argv[i], "label=", 6)) label = value;
+    }
+    if (scans < 1) scans = 1;
+
+    BMSUtil::begin();
+    Logger::setLoglevel(Logger::Off);
+
+    printf("label,modules,baud,latency_us,error_rate,scan_avg_us,scan_max_us,bus_busy,samples_per_s_per_cell,frames_per_scan,pack_ok\n");
+    for (size_t m = 0; m < modules.size(); m++)
+        for (size_t b = 0; b < bauds.size(); b++)
+            for (size_t l = 0; l < latencies.size(); l++)
+                for (size_t e = 0; e < errors.size(); e++)
+                {
+                    int count = (int)modules[m];
+                    if (count < 1 || count > SIM_MAX_MODULES) continue;
+                    runCase(label, count, (unsigned long)bauds[b], (uint32_t)latencies[l], errors[e], scans);
+                }
+    return 0;
+}
@@ -0,0 +1,217 @@
+#include <Arduino.h>
+#include <chrono>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "HostClock.h"
+#include "esp_heap_caps.h"
+
+#define HOST_PINS 64
+
+static uint64_t clockNow = 0;
+static uint8_t pinLevel[HOST_PINS];
+static bool pinsReady = false;
+
+HardwareSerial Serial(-1);
+EspClass ESP;
+
+//ports are registered from constructors of globals in other files, so no plain static vector
+static std::vector<HardwareSerial *> &ports()
+{
+    static std::vector<HardwareSerial *> list;
+    return list;
+}
+
+uint64_t HostClock::now()
+{
+    return clockNow;
+}
+
+void HostClock::reset()
+{
+    clockNow = 0;
+}
+
+void HostClock::addPort(HardwareSerial *port)
+{
+    ports().push_back(port);
+}
+
+bool HostClock::step(uint64_t deadline)
+{
+    HardwareSerial *next = NULL;
+    uint64_t nextAt = deadline;
+    uint64_t when;
+
+    for (size_t i = 0; i < ports().size(); i++)
+    {
+        if (ports()[i]->nextEvent(when) && when <= nextAt)
+        {
+            nextAt = when;
+            next = ports()[i];
+        }
+    }
+    if (next == NULL && deadline == UINT64_MAX) return false; //waiting forever on nothing, leave the clock alone
+    if (nextAt > clockNow) clockNow = nextAt;
+    if (next == NULL) return false;
+    next->raiseEvent();
+    return true;
+}
+
+void HostClock::advanceTo(uint64_t time)
+{
+    while (step(time));
+}
+
+void HostClock::advance(uint64_t us)
+{
+    advanceTo(clockNow + us);
+}
+
+uint32_t millis()
+{
+    return (uint32_t)(clockNow / 1000);
+}
+
+uint32_t micros()
+{
+    return (uint32_t)clockNow;
+}
+
+void delay(uint32_t ms)
+{
+    HostClock::advance(ms * 1000ULL);
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    HostClock::advance(us);
+}
+
+void yield()
+{
+}
+
+//Inputs float high (the fault line is active low) until a test drives them with digitalWrite
+void pinMode(uint8_t pin, uint8_t mode)
+{
+}
+
+int digitalRead(uint8_t pin)
+{
+    if (!pinsReady) return HIGH;
+    return (pin < HOST_PINS) ? pinLevel[pin] : LOW;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    if (!pinsReady)
+    {
+        memset(pinLevel, HIGH, sizeof(pinLevel));
+        pinsReady = true;
+    }
+    if (pin < HOST_PINS) pinLevel[pin] = value ? HIGH : LOW;
+}
+
+//Real time, not the virtual clock: Benchmark measures how long the host CPU takes for the code.
+//The TSC where there is one, nanoseconds otherwise.
+uint32_t EspClass::getCycleCount()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return (uint32_t)__rdtsc();
+#else
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+uint32_t EspClass::getFreeHeap()
+{
+    return heap_caps_get_free_size(MALLOC_CAP_8BIT);
+}
+
+uint32_t EspClass::getHeapSize()
+{
+    return HOST_HEAP_SIZE;
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+    size_t n = 0;
+    while (size--) n += write(*buffer++);
+    return n;
+}
+
+size_t Print::print(const String &str)
+{
+    return write(str.c_str());
+}
+
+size_t Print::print(long value, int base)
+{
+    if (base != DEC || value >= 0) return print((unsigned long)value, base);
+    return print('-') + print((unsigned long)-value, base);
+}
+
+size_t Print::print(unsigned long value, int base)
+{
+    char buf[8 * sizeof(long) + 1];
+    char *str = &buf[sizeof(buf) - 1];
+
+    if (base < 2) base = DEC;
+    *str = 0;
+    do
+    {
+        int digit = value % base;
+        *--str = digit < 10 ? '0' + digit : 'A' + digit - 10;
+        value /= base;
+    } while (value);
+    return write(str);
+}
+
+size_t Print::print(double value, int digits)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", digits, value);
+    return write(buf);
+}
+
+size_t Print::printf(const char *format, ...)
+{
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    return write(buf);
+}
+
+void String::fromLong(long number, unsigned char base)
+{
+    char buf[8 * sizeof(long) + 2];
+    if (base == DEC) snprintf(buf, sizeof(buf), "%ld", number);
+    else if (base == HEX) snprintf(buf, sizeof(buf), "%lx", (unsigned long)number);
+    else if (base == OCT) snprintf(buf, sizeof(buf), "%lo", (unsigned long)number);
+    else
+    {
+        unsigned long bits = number;
+        char *str = &buf[sizeof(buf) - 1];
+        *str = 0;
+        do
+        {
+            *--str = '0' + (bits & 1);
+            bits >>= 1;
+        } while (bits);
+        value = str;
+        return;
+    }
+    value = buf;
+}
+
+void String::fromDouble(double number, unsigned char decimals)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", decimals, number);
+    value = buf;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+/*
+ * Just enough of the Arduino core to build the BMS sources on Linux. Time comes from HostClock, a
+ * virtual clock that only moves when the code waits (delay, semaphore timeouts) so runs against
+ * the module chain simulator are repeatable and independent of how fast the host is.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HEX 16
+#define DEC 10
+#define OCT 8
+#define BIN 2
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+#define SERIAL_8N1 0x800001c
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t value);
+
+class String;
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *str) { return str ? write((const uint8_t *)str, strlen(str)) : 0; }
+
+    size_t print(const char *str) { return write(str); }
+    size_t print(const String &str);
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(unsigned char value, int base = DEC) { return print((unsigned long)value, base); }
+    size_t print(int value, int base = DEC) { return print((long)value, base); }
+    size_t print(unsigned int value, int base = DEC) { return print((unsigned long)value, base); }
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+    size_t print(long long value, int base = DEC) { return print((long)value, base); }
+    size_t print(unsigned long long value, int base = DEC) { return print((unsigned long)value, base); }
+    size_t print(double value, int digits = 2);
+    size_t printf(const char *format, ...);
+
+    size_t println() { return write("\r\n"); }
+    template <typename T> size_t println(T value) { size_t n = print(value); return n + println(); }
+    template <typename T> size_t println(T value, int format) { size_t n = print(value, format); return n + println(); }
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() { return -1; }
+    virtual void flush() {}
+};
+
+class String
+{
+public:
+    String() {}
+    String(const char *str) : value(str ? str : "") {}
+    String(const std::string &str) : value(str) {}
+    String(char c) : value(1, c) {}
+    String(int number, unsigned char base = DEC) { fromLong(number, base); }
+    String(unsigned int number, unsigned char base = DEC) { fromLong(number, base); }
+    String(long number, unsigned char base = DEC) { fromLong(number, base); }
+    String(unsigned long number, unsigned char base = DEC) { fromLong((long)number, base); }
+    String(float number, unsigned char decimals = 2) { fromDouble(number, decimals); }
+    String(double number, unsigned char decimals = 2) { fromDouble(number, decimals); }
+
+    const char *c_str() const { return value.c_str(); }
+    unsigned int length() const { return value.size(); }
+    char operator[](unsigned int index) const { return index < value.size() ? value[index] : 0; }
+    bool operator==(const String &other) const { return value == other.value; }
+    bool operator!=(const String &other) const { return value != other.value; }
+
+    String &operator+=(const String &other) { value += other.value; return *this; }
+    String &operator+=(const char *other) { value += other; return *this; }
+    String &operator+=(char other) { value += other; return *this; }
+    template <typename T> String &operator+=(T other) { return *this += String(other); }
+
+    friend String operator+(const String &lhs, const String &rhs) { String result(lhs); result += rhs; return result; }
+    friend String operator+(const String &lhs, const char *rhs) { String result(lhs); result += rhs; return result; }
+    template <typename T> friend String operator+(const String &lhs, T rhs) { return lhs + String(rhs); }
+
+private:
+    std::string value;
+
+    void fromLong(long number, unsigned char base);
+    void fromDouble(double number, unsigned char decimals);
+};
+
+class EspClass
+{
+public:
+    uint32_t getCycleCount();
+    uint32_t getCpuFreqMHz() { return 240; }
+    uint32_t getFreeHeap();
+    uint32_t getHeapSize();
+};
+extern EspClass ESP;
+
+#include "HardwareSerial.h"
+extern HardwareSerial Serial;
@@ -0,0 +1,148 @@
+#include <Arduino.h>
+#include "HostClock.h"
+
+HardwareSerial::HardwareSerial(int uartNum)
+{
+    this->uartNum = uartNum;
+    baudRate = 115200;
+    rxTimeout = 2;   //driver defaults
+    fifoFull = 120;
+    callback = NULL;
+    peer = NULL;
+    rxFilter = NULL;
+    unsignalled = 0;
+    HostClock::addPort(this);
+}
+
+void HardwareSerial::begin(unsigned long baud, uint32_t config, int8_t rxPin, int8_t txPin)
+{
+    if (baud > 0) baudRate = baud;
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+    if (uartNum < 0) return fwrite(buffer, 1, size, stdout);
+    if (peer) peer->receive(*this, buffer, size);
+    return size;
+}
+
+int HardwareSerial::available()
+{
+    int count = 0;
+    uint64_t now = HostClock::now();
+    for (size_t i = 0; i < rxQueue.size() && rxQueue[i].arrival <= now; i++) count++;
+    return count;
+}
+
+int HardwareSerial::read()
+{
+    if (rxQueue.empty() || rxQueue.front().arrival > HostClock::now()) return -1;
+    uint8_t c = rxQueue.front().data;
+    rxQueue.pop_front();
+    if (unsignalled > rxQueue.size()) unsignalled = rxQueue.size();
+    return c;
+}
+
+int HardwareSerial::peek()
+{
+    if (rxQueue.empty() || rxQueue.front().arrival > HostClock::now()) return -1;
+    return rxQueue.front().data;
+}
+
+void HardwareSerial::onReceive(OnReceiveCb function, bool onlyOnTimeout)
+{
+    callback = function;
+}
+
+bool HardwareSerial::setRxTimeout(uint8_t symbols)
+{
+    rxTimeout = symbols;
+    return true;
+}
+
+bool HardwareSerial::setRxFIFOFull(uint8_t bytes)
+{
+    fifoFull = bytes ? bytes : 1;
+    return true;
+}
+
+void HardwareSerial::attach(SerialPeer *peer)
+{
+    this->peer = peer;
+}
+
+void HardwareSerial::setRxFilter(SerialFilter *filter)
+{
+    rxFilter = filter;
+}
+
+void HardwareSerial::inject(const uint8_t *data, size_t len, uint64_t firstByteAt)
+{
+    if (rxFilter) rxFilter->filter(*this, data, len, firstByteAt);
+    else deliver(data, len, firstByteAt);
+}
+
+void HardwareSerial::deliver(const uint8_t *data, size_t len, uint64_t firstByteAt)
+{
+    uint64_t arrival = firstByteAt;
+    RxByte b;
+
+    //bytes can't overtake each other on the wire
+    if (!rxQueue.empty() && rxQueue.back().arrival + getByteTime() > arrival) arrival = rxQueue.back().arrival + getByteTime();
+    for (size_t i = 0; i < len; i++)
+    {
+        b.data = data[i];
+        b.arrival = arrival;
+        rxQueue.push_back(b);
+        arrival += getByteTime();
+    }
+    unsignalled += len;
+}
+
+uint32_t HardwareSerial::getByteTime()
+{
+    return (10000000UL + baudRate - 1) / baudRate; //start + 8 data + stop bits
+}
+
+/*
+ * When the driver would next call the onReceive callback and for how many bytes: once fifoFull bytes
+ * are waiting, or when the line has been quiet for rxTimeout symbols after a byte.
+ */
+size_t HardwareSerial::pendingEvent(uint64_t &when)
+{
+    size_t first = rxQueue.size() - unsignalled;
+    uint64_t idle = rxTimeout * getByteTime();
+
+    for (size_t k = 0; k < unsignalled; k++)
+    {
+        size_t i = first + k;
+        if (k + 1 == fifoFull)
+        {
+            when = rxQueue[i].arrival;
+            return k + 1;
+        }
+        if (i + 1 == rxQueue.size() || rxQueue[i + 1].arrival > rxQueue[i].arrival + idle)
+        {
+            when = rxQueue[i].arrival + idle;
+            return k + 1;
+        }
+    }
+    return 0;
+}
+
+bool HardwareSerial::nextEvent(uint64_t &when)
+{
+    return pendingEvent(when) > 0;
+}
+
+void HardwareSerial::raiseEvent()
+{
+    uint64_t when;
+    unsignalled -= pendingEvent(when);
+    if (callback) callback();
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Arduino.h"
+#include <deque>
+
+class HardwareSerial;
+
+/*
+ * Whatever sits on the far end of a host serial port, e.g. the module chain simulator. It gets the
+ * bytes the firmware writes and answers through HardwareSerial::inject().
+ */
+class SerialPeer
+{
+public:
+    virtual ~SerialPeer() {}
+    virtual void receive(HardwareSerial &port, const uint8_t *data, size_t len) = 0;
+};
+
+/*
+ * Optional stage between the peer and the receive queue (see HardwareSerial::setRxFilter). It gets
+ * what the peer injects and passes on whatever it likes with HardwareSerial::deliver().
+ */
+class SerialFilter
+{
+public:
+    virtual ~SerialFilter() {}
+    virtual void filter(HardwareSerial &port, const uint8_t *data, size_t len, uint64_t firstByteAt) = 0;
+};
+
+typedef void (*OnReceiveCb)(void);
+
+/*
+ * Host stand in for the ESP32 UART driver. Port -1 is the console and goes to stdout/stdin, any
+ * other port talks to an attached SerialPeer. Received bytes carry their arrival time on the virtual
+ * clock and the onReceive callback fires the way the driver would raise it: when the RX FIFO
+ * threshold is reached or the line has been idle for the RX timeout.
+ */
+class HardwareSerial : public Stream
+{
+public:
+    explicit HardwareSerial(int uartNum);
+
+    void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1);
+    void end() {}
+    operator bool() const { return true; }
+
+    using Print::write;
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+    int available();
+    int read();
+    int peek();
+    void flush() {}
+
+    void onReceive(OnReceiveCb function, bool onlyOnTimeout = false);
+    bool setRxTimeout(uint8_t symbols);
+    bool setRxFIFOFull(uint8_t bytes);
+
+    //host side
+    void attach(SerialPeer *peer);
+    void setRxFilter(SerialFilter *filter);
+    void inject(const uint8_t *data, size_t len, uint64_t firstByteAt); //bytes arrive back to back from firstByteAt on
+    void deliver(const uint8_t *data, size_t len, uint64_t firstByteAt); //same, bypassing the filter
+    uint32_t getByteTime();                                              //us per byte on the wire (8N1)
+    bool nextEvent(uint64_t &when);
+    void raiseEvent();
+
+private:
+    struct RxByte
+    {
+        uint8_t data;
+        uint64_t arrival;
+    };
+
+    int uartNum;
+    unsigned long baudRate;
+    uint8_t rxTimeout;
+    uint8_t fifoFull;
+    OnReceiveCb callback;
+    SerialPeer *peer;
+    SerialFilter *rxFilter;
+    std::deque<RxByte> rxQueue;
+    size_t unsignalled;         //bytes at the end of rxQueue the callback has not been told about
+
+    size_t pendingEvent(uint64_t &when);
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+class HardwareSerial;
+
+/*
+ * Virtual microsecond clock behind millis()/micros() on the host. Waiting moves it forward and
+ * delivers whatever the serial ports have scheduled in the meantime (receive interrupts), so the
+ * firmware sees replies arrive exactly when the simulated bus timing says they would.
+ */
+class HostClock
+{
+public:
+    static uint64_t now();
+    static void reset();
+
+    //Move the clock to the given time, raising every serial receive event due on the way
+    static void advanceTo(uint64_t time);
+    static void advance(uint64_t us);
+
+    //Move the clock to the next serial receive event if there is one before the deadline and raise
+    //it. Returns false (with the clock at the deadline) when nothing happened.
+    static bool step(uint64_t deadline);
+
+    static void addPort(HardwareSerial *port);
+};
@@ -0,0 +1,3 @@
+#pragma once
+
+//BMSModule.cpp and BMSModuleManager.cpp include config.h; nothing in it is needed on the host
@@ -0,0 +1,84 @@
+#include <malloc.h>
+#include <new>
+#include <stdlib.h>
+#include "esp_heap_caps.h"
+
+static size_t allocatedBlocks = 0;
+static size_t allocatedBytes = 0;
+static size_t peakBytes = 0;
+
+/*
+ * Count every C++ allocation (that is where String and the containers get their memory from). Not
+ * under AddressSanitizer, it brings its own operator new and the counts just stay at 0.
+ */
+#if !defined(__SANITIZE_ADDRESS__)
+void *operator new(size_t size)
+{
+    void *p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    allocatedBlocks++;
+    allocatedBytes += malloc_usable_size(p);
+    if (allocatedBytes > peakBytes) peakBytes = allocatedBytes;
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    if (!p) return;
+    allocatedBlocks--;
+    allocatedBytes -= malloc_usable_size(p);
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    operator delete(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    operator delete(p);
+}
+#endif
+
+static size_t freeBytes()
+{
+    return (allocatedBytes < HOST_HEAP_SIZE) ? HOST_HEAP_SIZE - allocatedBytes : 0;
+}
+
+//No fragmentation on the host, the largest block is all that is free
+void heap_caps_get_info(multi_heap_info_t *info, uint32_t caps)
+{
+    info->total_free_bytes = freeBytes();
+    info->total_allocated_bytes = allocatedBytes;
+    info->largest_free_block = freeBytes();
+    info->minimum_free_bytes = heap_caps_get_minimum_free_size(caps);
+    info->allocated_blocks = allocatedBlocks;
+    info->free_blocks = 1;
+    info->total_blocks = allocatedBlocks + 1;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    return freeBytes();
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+    return (peakBytes < HOST_HEAP_SIZE) ? HOST_HEAP_SIZE - peakBytes : 0;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    return freeBytes();
+}
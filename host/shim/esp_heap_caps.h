@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//The ESP-IDF heap statistics HeapMonitor reads, from the host C++ allocations (operator new/delete)
+#define MALLOC_CAP_DEFAULT  (1 << 12)
+#define MALLOC_CAP_8BIT     (1 << 2)
+
+//A pretend heap the size of the ESP32-S3 internal RAM left to the sketch, so free sizes look familiar
+#define HOST_HEAP_SIZE      (320 * 1024)
+
+typedef struct
+{
+    size_t total_free_bytes;
+    size_t total_allocated_bytes;
+    size_t largest_free_block;
+    size_t minimum_free_bytes;
+    size_t allocated_blocks;
+    size_t free_blocks;
+    size_t total_blocks;
+} multi_heap_info_t;
+
+void heap_caps_get_info(multi_heap_info_t *info, uint32_t caps);
+size_t heap_caps_get_free_size(uint32_t caps);
+size_t heap_caps_get_minimum_free_size(uint32_t caps);
+size_t heap_caps_get_largest_free_block(uint32_t caps);
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+//The bits of the FreeRTOS API the BMS code uses, backed by the host virtual clock (1 tick = 1 ms)
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+
+#define pdTRUE              1
+#define pdFALSE             0
+#define pdPASS              pdTRUE
+#define portMAX_DELAY       ((TickType_t)0xFFFFFFFF)
+#define portTICK_PERIOD_MS  1
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(ms))
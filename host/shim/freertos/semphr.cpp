@@ -0,0 +1,33 @@
+#include "semphr.h"
+#include "HostClock.h"
+
+struct HostSemaphore
+{
+    bool given;
+};
+
+SemaphoreHandle_t xSemaphoreCreateBinary()
+{
+    SemaphoreHandle_t semaphore = new HostSemaphore;
+    semaphore->given = false;
+    return semaphore;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    if (semaphore->given) return pdFALSE;
+    semaphore->given = true;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+    uint64_t deadline = (ticks == portMAX_DELAY) ? UINT64_MAX : HostClock::now() + ticks * 1000ULL;
+
+    while (!semaphore->given)
+    {
+        if (!HostClock::step(deadline)) return pdFALSE;
+    }
+    semaphore->given = false;
+    return pdTRUE;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef struct HostSemaphore *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary();
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+//Blocking runs the virtual clock forward, delivering serial receive events, until given or timed out
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
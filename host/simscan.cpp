@@ -0,0 +1,99 @@
+/*
+ * Runs the unmodified BMSModuleManager against a simulated chain of module boards and reports how
+ * long enumeration and full pack scans take on the bus (virtual time) and on the host CPU.
+ *
+ *   ./simscan [modules 1-62] [scans]        (built by host/CMakeLists.txt)
+ *
+ * Exits non zero if the manager does not find every module or reads back other voltages than the
+ * simulator was given.
+ */
+#include <Arduino.h>
+#include <chrono>
+#include "HostClock.h"
+#include "ModuleChainSim.h"
+#include "BMSModuleManager.h"
+#include "BMSUtil.h"
+#include "Logger.h"
+#include "BMSProfiler.h"
+#include "HeapMonitor.h"
+
+HardwareSerial SERIALBMS(1);
+BMSModuleManager bms;
+String bms_status, bms_modules_text;
+EEPROMSettings settings;
+
+int main(int argc, char **argv)
+{
+    int modules = (argc > 1) ? atoi(argv[1]) : BMS_NUM_SERIES;
+    int scans = (argc > 2) ? atoi(argv[2]) : 100;
+    float expected = 0.0f;
+    uint64_t start, scanMin = UINT64_MAX, scanMax = 0, scanSum = 0;
+    double hostNs = 0.0;
+    int found;
+
+    if (modules < 1 || modules > SIM_MAX_MODULES || scans < 1)
+    {
+        fprintf(stderr, "usage: %s [modules 1-%d] [scans]\n", argv[0], SIM_MAX_MODULES);
+        return 2;
+    }
+
+    ModuleChainSim chain(modules);
+    for (int m = 0; m < modules; m++)
+    {
+        for (int c = 0; c < 6; c++)
+        {
+            float volts = 3.60f + 0.01f * ((m * 6 + c) % 11);
+            chain.setCellVoltage(m, c, volts);
+            expected += volts;
+        }
+        chain.setTemperature(m, 0, 20.0f + m % 5);
+        chain.setTemperature(m, 1, 22.0f + m % 3);
+    }
+    chain.attach(SERIALBMS);
+
+    SERIALBMS.begin(612500, SERIAL_8N1);
+    BMSUtil::begin();
+    Logger::setLoglevel(Logger::Off);
+
+    start = HostClock::now();
+    bms.renumberBoardIDs();
+    bms.findBoards();
+    bms.setPstrings(1);
+    bms.clearFaults();
+    printf("enumerated in %.2f ms (virtual)\n", (HostClock::now() - start) / 1000.0);
+
+    for (int i = 0; i < scans; i++)
+    {
+        std::chrono::steady_clock::time_point hostStart = std::chrono::steady_clock::now();
+        start = HostClock::now();
+        bms.getAllVoltTemp();
+        uint64_t took = HostClock::now() - start;
+        hostNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - hostStart).count();
+        if (took < scanMin) scanMin = took;
+        if (took > scanMax) scanMax = took;
+        scanSum += took;
+        HeapMonitor::loopIteration();
+    }
+
+    //cells are spread over 100mV so every module has something to balance
+    start = HostClock::now();
+    bms.balanceCells();
+    printf("balance command for all modules took %lu us (virtual)\n", (unsigned long)(HostClock::now() - start));
+
+    found = 0;
+    for (int m = 0; m < modules; m++) if (chain.getAddress(m) == m + 1) found++;
+    printf("modules %d, addressed %d, frames %lu\n", modules, found, (unsigned long)chain.getFrameCount());
+    printf("scan bus time us min/avg/max: %lu / %lu / %lu\n", (unsigned long)scanMin,
+           (unsigned long)(scanSum / scans), (unsigned long)scanMax);
+    printf("scan host cpu: %.1f us\n", hostNs / scans / 1000.0);
+    printf("pack %.3f V (simulated %.3f V)\n", bms.getPackVoltage(), expected);
+    //host TSC cycles shown as if at 240MHz, and the bus waits take no real time here
+    BMSProfiler::print();
+    //allocations of the host C++ runtime, the same String code as on the board
+    HeapMonitor::print();
+
+    if (found != modules) return 1;
+    //the ADC has 14 bit resolution, half an LSB (0.19mV) per cell of rounding error
+    if (fabsf(bms.getPackVoltage() - expected) > modules * 0.01f) return 1;
+    return 0;
+}
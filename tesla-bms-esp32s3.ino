@@ -16,11 +16,22 @@
 HardwareSerial SERIALBMS(0);
 
 #include "BMSModuleManager.h" 
+#include "BMSUtil.h"
 #include "Logger.h"
+#include "BMSProfiler.h"
+#include "LoopMonitor.h"
+#include "HeapMonitor.h"
+#include "SerialConsole.h"
 BMSModuleManager bms; 
+SerialConsole console;
 String bms_status, bms_modules_text;
 lv_obj_t *bms_label;
 
+#define VOLT_INTERVAL_MS    5000
+#define PAGE_INTERVAL_MS    5000
+#define LABEL_INTERVAL_MS   1000
+#define UI_LATE_BUDGET_MS   250   //the UI jobs may slip this much before it counts as an overrun
+
 esp_lcd_panel_io_handle_t io_handle = NULL;
 static lv_disp_draw_buf_t disp_buf; // contains internal graphic buffer(s) called draw buffer(s)
 static lv_disp_drv_t disp_drv;      // contains callback functions
@@ -144,6 +155,7 @@ void setup() {
   is_initialized_lvgl = true;
 
   SERIALBMS.begin(612500, SERIAL_8N1, /* rx */ GPIO_NUM_2, /* tx */ GPIO_NUM_1);
+  BMSUtil::begin();
 
 #if USE_WIFI
   wifi_test();
@@ -163,17 +175,28 @@ void setup() {
   bms.setPstrings(BMS_NUM_PARALLEL);
   //bms.setSensors(settings.IgnoreTemp, settings.IgnoreVolt); 
 
-  last_tick2 = millis() + 5000;
+  last_tick2 = millis() + PAGE_INTERVAL_MS;
+
+  LoopMonitor::setJob(JOB_BMS_POLL, BMS_POLL_INTERVAL_MS, BMS_POLL_LATE_BUDGET_MS);
+  LoopMonitor::setJob(JOB_BALANCE, 0, 0);
+  LoopMonitor::setJob(JOB_BATTERY_VOLT, VOLT_INTERVAL_MS, UI_LATE_BUDGET_MS);
+  LoopMonitor::setJob(JOB_PAGE_SWITCH, PAGE_INTERVAL_MS, UI_LATE_BUDGET_MS);
+  LoopMonitor::setJob(JOB_LABEL, LABEL_INTERVAL_MS, UI_LATE_BUDGET_MS);
 }
 
 void loop() {
-  lv_timer_handler();
+  {
+    BMS_PROFILE(PROF_UI);
+    lv_timer_handler();
+  }
+  console.loop();
 
   // process BMS data
   static uint32_t looptime = 0;
-  if (millis() - looptime > 500)
+  if (millis() - looptime > BMS_POLL_INTERVAL_MS)
   {
     looptime = millis();
+    LoopMonitor::start(JOB_BMS_POLL);
     bms.getAllVoltTemp();
 
     // check if balancing is needed
@@ -190,7 +213,9 @@ void loop() {
       // Packs need to be balanced
       if (!last_balance_ms || (millis() >= (last_balance_ms + BALANCE_TIME_MS)))
       {
+        LoopMonitor::start(JOB_BALANCE);
         bms.balanceCells();
+        LoopMonitor::end(JOB_BALANCE);
         is_balancing = 1;
         last_balance_ms = millis();
       }
@@ -199,11 +224,13 @@ void loop() {
     {
       bms_status += "\n\n*** BALANCING ***";
     }
+    LoopMonitor::end(JOB_BMS_POLL);
   }
       
   static uint32_t last_tick;
-  if ((millis() - last_tick) > 5000) 
+  if ((millis() - last_tick) > VOLT_INTERVAL_MS) 
   {
+    LoopMonitor::start(JOB_BATTERY_VOLT);
 #if USE_WIFI
     struct tm timeinfo;
     if (getLocalTime(&timeinfo)) {
@@ -213,22 +240,32 @@ void loop() {
 #endif
     uint32_t volt = (analogRead(PIN_BAT_VOLT) * 2 * 3.3 * 1000) / 4096;
     lv_msg_send(MSG_NEW_VOLT, &volt);
+    LoopMonitor::end(JOB_BATTERY_VOLT);
 
     last_tick = millis();
   }
 
-  if (millis() > last_tick2 && ((millis() - last_tick2) > 5000))
+  if (millis() > last_tick2 && ((millis() - last_tick2) > PAGE_INTERVAL_MS))
   {
+    LoopMonitor::start(JOB_PAGE_SWITCH);
     ui_switch_page();
+    LoopMonitor::end(JOB_PAGE_SWITCH);
     last_tick2 = millis();
   }
 
   static uint32_t last_tick3;
-  if ((millis() - last_tick3) > 1000)
+  if ((millis() - last_tick3) > LABEL_INTERVAL_MS)
   {
+    BMS_PROFILE(PROF_LABEL);
+    BMS_HEAP_SCOPE(HEAP_LABEL);
+    LoopMonitor::start(JOB_LABEL);
     lv_label_set_text(bms_label, (bms_status + "\n\n" + bms_modules_text).c_str());
+    LoopMonitor::end(JOB_LABEL);
     last_tick3 = millis();
   }
+#if BMS_HEAP_MONITOR
+  HeapMonitor::loopIteration();
+#endif
 }
 
 #if USE_WIFI